@@ -0,0 +1,151 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gpdefines.h"
+#include "gpnativetree.h"
+#include "gpreporting.h"
+#include <string>
+#include <vector>
+
+#if !defined( _WIN32 )
+#include <dlfcn.h>
+#include <unistd.h>
+#define GP_NATIVETREE_SUPPORTED
+#endif
+
+// name of the generated function, its binding function is this with _bind appended
+static const char* kNativeEntryName	= "libgp_native_tree";
+static const char* kNativeBindName	= "libgp_native_tree_bind";
+
+GPNativeTree::GPNativeTree()
+{
+	m_library		= NULL;
+	m_entry			= NULL;
+	m_return_type	= GP_INVALID_PARAMTYPE;
+}
+
+GPNativeTree::~GPNativeTree()
+{
+	Unload();
+}
+
+bool GPNativeTree::IsLoaded() const
+{
+	return m_entry != NULL;
+}
+
+void GPNativeTree::Unload()
+{
+#ifdef GP_NATIVETREE_SUPPORTED
+	if ( m_library ) dlclose( m_library );
+#endif
+
+	m_library		= NULL;
+	m_entry			= NULL;
+	m_return_type	= GP_INVALID_PARAMTYPE;
+}
+
+// ---------------------------------------------------------------------------
+// Compile
+//		Exports the tree, builds it as a shared library in a temporary folder
+//		and loads it. Returns true if the tree is ready to Execute().
+//
+bool GPNativeTree::Compile( const GPFunctionLookup& functions, const GPTree* tree, const char* return_type, const char* prelude, const char* compile_flags )
+{
+	Unload();
+
+#ifdef GP_NATIVETREE_SUPPORTED
+	std::stringstream source;
+	source << prelude << "\n\n";
+
+	if ( !ExportTreeCpp( functions, tree, kNativeEntryName, return_type, source, true ) )
+	{
+		return false;
+	}
+
+	char directory[] = "/tmp/libgpXXXXXX";
+	if ( mkdtemp( directory ) == NULL )
+	{
+		return false;
+	}
+
+	const std::string source_file	= std::string( directory ) + "/tree.cpp";
+	const std::string library_file	= std::string( directory ) + "/tree.so";
+
+	std::ofstream fout( source_file.c_str() );
+	fout << source.str();
+	fout.close();
+
+	const char* compiler = getenv( "CXX" );
+
+	std::stringstream command;
+	command << ( compiler ? compiler : "c++" ) << " -std=c++11 -O2 -shared -fPIC " << compile_flags;
+	command << " -o " << library_file << " " << source_file;
+
+	if ( system( command.str().c_str() ) == 0 )
+	{
+		m_library = dlopen( library_file.c_str(), RTLD_NOW | RTLD_LOCAL );
+	}
+
+	// once loaded the library stays mapped, so the files are no longer needed
+	remove( source_file.c_str() );
+	remove( library_file.c_str() );
+	rmdir( directory );
+
+	if ( m_library == NULL )
+	{
+		return false;
+	}
+
+	typedef void(*BindSignature)( void* const* );
+	BindSignature bind_func = reinterpret_cast< BindSignature >( dlsym( m_library, kNativeBindName ) );
+	void* entry = dlsym( m_library, kNativeEntryName );
+
+	if ( bind_func == NULL || entry == NULL )
+	{
+		Unload();
+		return false;
+	}
+
+	// hand the compiled code the pointers to the registered functions
+	std::vector< void* > table( functions.GetNumFunctions(), (void*)NULL );
+	for( int i = 0; i < functions.GetNumFunctions(); ++i )
+	{
+		const GPFunctionDesc& this_function = functions.GetFunctionByID( i );
+
+		if ( this_function.m_member_owner == 0 )
+		{
+			memcpy( &table[ i ], this_function.m_function_ptr, sizeof( void* ) );
+		}
+	}
+	bind_func( &table[ 0 ] );
+
+	m_entry			= entry;
+	m_return_type	= functions.GetFunctionByID( tree->Root()->functionID ).m_return_type;
+
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,85 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPNATIVETREE_H
+#define GPNATIVETREE_H
+
+#include "gpfunctionlookup.h"
+
+// ---------------------------------------------------------------------------
+// GPNativeTree
+//
+// Compiles a tree into native code with the local C++ compiler, and loads the
+// result back in. Long lived individuals (elites, or a champion which is being
+// deployed) then execute at the speed of hand written code.
+//
+// The source is generated by ExportTreeCpp. The compiled code calls the
+// registered functions through the pointers already stored in the
+// GPFunctionLookup, so the host program does not need to export any symbols.
+//
+// Limitations:
+//	* Only free functions can be compiled (see ExportTreeCpp).
+//	* The compiler is run through system(), using $CXX if set or "c++"
+//	  otherwise. Needs dlopen(), so is not available on Windows.
+//	* Compiling takes a good fraction of a second, so this only pays off for
+//	  individuals which are going to be executed a great many times.
+//
+class GPNativeTree
+{
+public:
+	GPNativeTree();
+	~GPNativeTree();
+
+	// prelude is placed ahead of the generated code and must declare every function
+	// the tree uses (typically an #include). compile_flags are added to the compiler
+	// command line, ie: "-I/path/to/libGP/include".
+	bool	Compile( const GPFunctionLookup& functions, const GPTree* tree, const char* return_type, const char* prelude, const char* compile_flags = "" );
+
+	bool	IsLoaded() const;
+	void	Unload();
+
+	template< class R >
+		R Execute() const;
+
+private:
+	// the loaded library is owned, so no copying
+	GPNativeTree( const GPNativeTree& );
+	GPNativeTree& operator=( const GPNativeTree& );
+
+	void*		m_library;
+	void*		m_entry;
+	GPTypeID	m_return_type;
+};
+
+template< class R >
+R GPNativeTree::Execute() const
+{
+	typedef R(*EntrySignature)();
+
+	// if this assert fires, the tree was compiled for a different return type
+	assert( IsLoaded() && GPGetTypeID< R >() == m_return_type );
+	return reinterpret_cast< EntrySignature >( m_entry )();
+}
+
+#endif
@@ -25,6 +25,7 @@
 #include "GPReporting.h"
 #include "GPStats.h"
 #include <sstream>
+#include <set>
 
 using std::ofstream;
 
@@ -79,7 +80,7 @@ void SaveAllIndividualsGraphViz( const GPEnvironment& environment, const char* p
 
 		fname << prefix << i << ".dot" << '\0';
 
-		SaveGraphViz( environment, fname.str().c_str(), environment.GetIndividualByIndex( i ) );
+		SaveGraphViz( environment.GetFunctions(), fname.str().c_str(), environment.GetIndividualByIndex( i ) );
 	}
 }
 
@@ -284,6 +285,108 @@ bool DeserializeTree( const GPFunctionLookup& functions, GPTree*& tree, std::str
 	return true;
 }
 
+namespace {
+void ExportFunctionName( const GPFunctionLookup& functions, GPFuncID function_id, bool bind_through_table, std::stringstream& out_source )
+{
+	if ( bind_through_table )
+	{
+		out_source << "gp_fn_" << function_id;
+	}
+	else
+	{
+		out_source << functions.GetFunctionByID( function_id ).m_debug_name;
+	}
+}
+
+void ExportNodeCpp( const GPFunctionLookup& functions, const GPTreeNode* node, int depth, bool bind_through_table, std::stringstream& out_source )
+{
+	const GPFunctionDesc&	this_function	= functions.GetFunctionByID( node->functionID );
+	const bool				is_delayed		= this_function.m_original_function_id != GPFunctionLookup::NULLFUNC;
+	const GPFuncID			call_id			= is_delayed ? this_function.m_original_function_id : node->functionID;
+
+	// a delayed parameter is wrapped in a lambda, so it is only called if the
+	// function taking it calls Evaluate()
+	if ( is_delayed )
+	{
+		out_source << "GPMakeDelayedEvaluation( +[]() { return ";
+	}
+
+	ExportFunctionName( functions, call_id, bind_through_table, out_source );
+	out_source << "(";
+
+	for( int p = 0; p < this_function.m_nparams; ++p )
+	{
+		out_source << ( p == 0 ? "\n" : ",\n" );
+		for( int i = 0; i <= depth; ++i )
+		{
+			out_source << "\t";
+		}
+
+		ExportNodeCpp( functions, node->parameters[ p ], depth + 1, bind_through_table, out_source );
+	}
+
+	out_source << ( this_function.m_nparams ? " )" : ")" );
+
+	if ( is_delayed )
+	{
+		out_source << "; } )";
+	}
+}
+}
+
+// ---------------------------------------------------------------------------
+// ExportTreeCpp
+//		Writes the tree out as a C++ function, so a finished individual can be
+//		compiled into a program rather than executed through ExecuteTree.
+//		Returns true on success.
+//
+//	Limitations:
+//		Only free functions can be exported, and they are called by their
+//		registered name.
+//
+bool ExportTreeCpp( const GPFunctionLookup& functions, const GPTree* tree, const char* function_name, const char* return_type, std::stringstream& out_source, bool bind_through_table )
+{
+	GPConstSubtreeIter flattened( tree );
+
+	// every function called has to be a free function we can name
+	std::set< GPFuncID > used_functions;
+	for( int i = 0; i < flattened.Count(); ++i )
+	{
+		const GPFunctionDesc&	this_function	= functions.GetFunctionByID( flattened.GetNode( i )->functionID );
+		const bool				is_delayed		= this_function.m_original_function_id != GPFunctionLookup::NULLFUNC;
+
+		if ( this_function.m_member_owner != 0 )
+		{
+			return false;
+		}
+
+		used_functions.insert( is_delayed ? this_function.m_original_function_id : flattened.GetNode( i )->functionID );
+	}
+
+	out_source << "// exported from libGP\n";
+
+	if ( bind_through_table )
+	{
+		// the pointers all have the same type as the function they stand in for
+		for( std::set< GPFuncID >::const_iterator iter = used_functions.begin(); iter != used_functions.end(); ++iter )
+		{
+			out_source << "static decltype( &" << functions.GetFunctionByID( *iter ).m_debug_name << " ) gp_fn_" << *iter << ";\n";
+		}
+
+		out_source << "\nextern \"C\" void " << function_name << "_bind( void* const* table )\n{\n";
+		for( std::set< GPFuncID >::const_iterator iter = used_functions.begin(); iter != used_functions.end(); ++iter )
+		{
+			out_source << "\tgp_fn_" << *iter << " = reinterpret_cast< decltype( gp_fn_" << *iter << " ) >( table[ " << *iter << " ] );\n";
+		}
+		out_source << "}\n\nextern \"C\" ";
+	}
+
+	out_source << return_type << " " << function_name << "()\n{\n\treturn ";
+	ExportNodeCpp( functions, tree->Root(), 1, bind_through_table, out_source );
+	out_source << ";\n}\n";
+
+	return true;
+}
 
 void HTMLGraphSeries( const char* filename, const GPStats* stats, const char* statname )
 {
@@ -44,6 +44,16 @@ void SerializeTree( const GPFunctionLookup& functions, const GPTree* tree, std::
 // LIMITATION: all of the names of the functions cannot have spaces in them!
 bool DeserializeTree( const GPFunctionLookup& functions, GPTree*& tree, std::stringstream& in_serialized );
 
+// given tree returned as C++ source for a function taking no parameters, which calls the
+// registered functions directly by name. return_type is how the tree's return type is
+// spelled in C++ (ie: "int"). the functions need to be declared before the returned code.
+// if bind_through_table is set, the functions are instead called through pointers which
+// must be filled in by calling function_name_bind() with a table indexed by function id
+// (this is how GPNativeTree loads it).
+// LIMITATION: member functions cannot be exported, and the registered names must be the
+// C++ names of the functions. returns false if this is not the case.
+bool ExportTreeCpp( const GPFunctionLookup& functions, const GPTree* tree, const char* function_name, const char* return_type, std::stringstream& out_source, bool bind_through_table = false );
+
 // WORK IN PROGRESS: function to save out a series from the stats tracker as html/jscript code
 // that will visualize it using Google Charts.
 // TODO: figure out a way that this can convert the stats stored type to string without having to know it
@@ -1,24 +1,43 @@
 set(Core_HEADER_FILES
+    ${PROJECT_SOURCE_DIR}/include/gpcasecache.h
     ${PROJECT_SOURCE_DIR}/include/gpdefines.h
     ${PROJECT_SOURCE_DIR}/include/gpenvironment.h
+    ${PROJECT_SOURCE_DIR}/include/gpevaluator.h
+    ${PROJECT_SOURCE_DIR}/include/gpfitnesscache.h
     ${PROJECT_SOURCE_DIR}/include/gpfunctionlookup.h
+    ${PROJECT_SOURCE_DIR}/include/gpislands.h
+    ${PROJECT_SOURCE_DIR}/include/gpjit.h
+    ${PROJECT_SOURCE_DIR}/include/gpselection.h
+    ${PROJECT_SOURCE_DIR}/include/gpstaticfunctionset.h
     ${PROJECT_SOURCE_DIR}/include/gpstats.h
     ${PROJECT_SOURCE_DIR}/include/gptree.h
+    ${PROJECT_SOURCE_DIR}/include/gptreebuilder.h
+    ${PROJECT_SOURCE_DIR}/include/gpworkerpool.h
 )
 
 set(Core_SOURCE_FILES
+    ${PROJECT_SOURCE_DIR}/src/gpcasecache.cpp
     ${PROJECT_SOURCE_DIR}/src/gpenvironment.cpp
+    ${PROJECT_SOURCE_DIR}/src/gpevaluator.cpp
+    ${PROJECT_SOURCE_DIR}/src/gpfitnesscache.cpp
     ${PROJECT_SOURCE_DIR}/src/gpfunctionlookup.cpp
     ${PROJECT_SOURCE_DIR}/src/gpglobals.cpp
+    ${PROJECT_SOURCE_DIR}/src/gpislands.cpp
+    ${PROJECT_SOURCE_DIR}/src/gpjit.cpp
+    ${PROJECT_SOURCE_DIR}/src/gpselection.cpp
     ${PROJECT_SOURCE_DIR}/src/gpstats.cpp
     ${PROJECT_SOURCE_DIR}/src/gptree.cpp
+    ${PROJECT_SOURCE_DIR}/src/gptreebuilder.cpp
+    ${PROJECT_SOURCE_DIR}/src/gpworkerpool.cpp
 )
 
 set(Aux_HEADER_FILES
+    ${PROJECT_SOURCE_DIR}/auxiliary/gpnativetree.h
     ${PROJECT_SOURCE_DIR}/auxiliary/gpreporting.h
 )
 
 set(Aux_SOURCE_FILES
+    ${PROJECT_SOURCE_DIR}/auxiliary/gpnativetree.cpp
     ${PROJECT_SOURCE_DIR}/auxiliary/gpreporting.cpp
 )
 
@@ -144,7 +144,7 @@ int main(int argc, char* argv[])
 	std::cout << "It took " << iterations << " iteration(s) to achieve the answer" << std::endl;
 
 	// save out to fittest.dot file for viewing
-	SaveGraphViz( environment, "fittest.dot", environment.GetIndividualByIndex( environment.GetFittestIndividual() ) );
+	SaveGraphViz( environment.GetFunctions(), "fittest.dot", environment.GetIndividualByIndex( environment.GetFittestIndividual() ) );
 	std::cout << "The fittest individual was saved to fittest.dot for viewing with Dotty graph viewer" << std::endl;
 
 	return 0;
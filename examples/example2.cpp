@@ -32,7 +32,8 @@
  * It intends to demonstrate:
  * - use of conditionals in GP structures
  * - use of varied return types
- * - a 'manual' way of controlling population evolution
+ * - a fitness function built from several test runs of each individual
+ * - a fitness function which gives up early on hopeless individuals
  *
  * The problem is:
  * Each GP is a dog. It begins at 0,0 and has to find a stick at x,y.
@@ -116,9 +117,8 @@ void If( const bool condition, const GPDelayedEvaluation< void > true_action, co
 }
 
 // ---------------------------------------------------------------------------
-// Next the fitness function. Explained in example1.cpp
-// NOTE that we dont expect our dog GP's to return anything. So by omitting
-// the 3rd parameter, the environment will assume it to be 'void'.
+// Next how well a dog did at fetching a single stick. Our dog GP's dont
+// return anything, so this looks at where they moved to instead.
 //
 GPFitness Fitness( GPEnvironment& environment, int individual_index )
 {
@@ -130,8 +130,9 @@ GPFitness Fitness( GPEnvironment& environment, int individual_index )
 
 // ---------------------------------------------------------------------------
 // Setup each individuals test case
-// This is an example of how one can perform the executions and fitness tests
-// 'manually' without the framework automatically assigning fitness.
+// Runs one throw for a dog: executes it for a number of turns, then grades
+// where it ended up. FetchSticks below calls this once per throw, and the
+// environment stores the average it returns as the dog's fitness.
 GPFitness EvaluateIndividual( GPEnvironment& environment, int individual_index )
 {
 	dog_x	= 0;
@@ -153,33 +154,30 @@ GPFitness EvaluateIndividual( GPEnvironment& environment, int individual_index )
 }
 
 // ---------------------------------------------------------------------------
-// Just loop through all the individuals
-void EvaluateAll( GPEnvironment& environment )
+// The fitness function the environment calls for each individual
+// For each dog, we'll run the test a number of times where each time a stick
+// will be thrown, and the dog will need to fetch it. Its fitness will be graded
+// as an average of these attempts.
+//
+// No throw can raise that average, so once the throws so far have dropped it
+// below the cutoff the environment passes in, this dog is not going to survive
+// into the next generation anyway, and the remaining throws can be skipped.
+GPFitness FetchSticks( GPEnvironment& environment, const int individual_index, const GPFitness cutoff )
 {
-	int n_individuals = environment.GetPopulationSize();
-	for( int i = 0; i < n_individuals; ++i )
+	const int kThrows = 10;
+
+	GPFitness total_fitness = 0;
+	for( int j = 0; j < kThrows; ++j )
 	{
-		// for each dog, we'll run the test a number of times
-		// where each time a stick will be thrown, and the dog
-		// will need to fetch it.
-		// its fitness will be graded as an average of these attempts.
-		GPFitness individual_fitness = 0;
-		const int kThrows = 10;
-		for( int j = 0; j < kThrows; ++j )
+		total_fitness += EvaluateIndividual( environment, individual_index );
+
+		if ( total_fitness / kThrows < cutoff )
 		{
-			individual_fitness += EvaluateIndividual( environment, i );
+			break;
 		}
-
-		individual_fitness = individual_fitness / kThrows;
-
-		// after putting the dog through its paces, we will manually call the fitness
-		// function to see how well it did. we can then override the fitness value
-		// which the framework has for it.
-		// NOTE: the framework needs to have either automatically called the Fitness
-		// or otherwise had it set with an OverrideIndividualFitness() call
-		// because it requires the fitness value to perform crossover and mutations.
-		environment.OverrideIndividualFitness( i, individual_fitness );
 	}
+
+	return total_fitness / kThrows;
 }
 
 // ---------------------------------------------------------------------------
@@ -205,9 +203,14 @@ int main(int argc, char* argv[])
 	environment.RegisterFunction( "StickIsRight",	StickIsRight );
 	environment.RegisterFunction( "If",				If );
 
-	// let it know a fitness function with which to test the GP's
-	// for each iteration. The fitness function has a standard signature
-	environment.SetFitnessFunction( Fitness );
+	// let it know a fitness function with which to test the GP's for each
+	// iteration. This one executes the individuals itself, so needs telling
+	// that they return void, and is handed a cutoff to give up at.
+	environment.SetBoundedFitnessFunction< void >( FetchSticks );
+
+	// each evaluation throws the stick somewhere new, so even individuals which
+	// survived unchanged from the last generation need testing again
+	environment.SetNoisyFitness( true );
 
 	// so all that is left is to let the environment know how big 
 	// we'll let the trees become, and how many individuals we want
@@ -223,9 +226,7 @@ int main(int argc, char* argv[])
 	environment.GenerateNewPopulation();
 
 	// evaluate the new population to get their fitness values
-	// NOTE: we're going to call our own function here! not the one
-	// on the framework.
-	EvaluateAll( environment );
+	environment.EvaluateAll();
 
 	// now we'll iterate until we reach our target fitness level
 	// (which for now we'll just require a 'perfect' answer)
@@ -235,7 +236,7 @@ int main(int argc, char* argv[])
 		// do the mutations and crossovers to generate the next generation
 		environment.MutateAndCrossover();
 
-		EvaluateAll( environment );
+		environment.EvaluateAll();
 
 		++iterations;
 	}
@@ -245,7 +246,7 @@ int main(int argc, char* argv[])
 	std::cout << "It took " << iterations << " iteration(s) to achieve the answer" << std::endl;
 
 	// save out to fittest.dot file for viewing
-	SaveGraphViz( environment, "fittest.dot", environment.GetIndividualByIndex( environment.GetFittestIndividual() ) );
+	SaveGraphViz( environment.GetFunctions(), "fittest.dot", environment.GetIndividualByIndex( environment.GetFittestIndividual() ) );
 	std::cout << "The fittest individual was saved to fittest.dot for viewing with Dotty graph viewer" << std::endl;
 
 	return 0;
@@ -0,0 +1,98 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPCASECACHE_H
+#define GPCASECACHE_H
+
+#include <map>
+#include "gpfunctionlookup.h"
+
+// ---------------------------------------------------------------------------
+// GPCaseCache
+//
+// Keeps the output of every node of one individual over all the fitness
+// cases. When the tree is changed (mutation replacing a subtree, crossover,
+// pruning) only the new nodes and their ancestors are recomputed on the next
+// Update, so re-evaluating an offspring costs O(depth x cases) rather than
+// O(nodes x cases).
+//
+// Nodes are recognised by address, along with their function and children.
+// A node is recomputed if it is new, if either of those changed, or if any
+// child was recomputed. Entries for nodes no longer in the tree are dropped
+// at the end of each Update.
+//
+// Limitations:
+//	* Only valid for pure functions - the only inputs to a tree may be the
+//	  terminals reading the case picked by the GPCaseSelector.
+//	* Nodes taking delayed parameters (conditionals) are re-executed for
+//	  every case whenever they are visited, and their subtrees are not cached.
+//	* Memory is one column per node, per individual.
+//
+class GPCaseCache
+{
+public:
+	GPCaseCache();
+	~GPCaseCache();
+
+	// brings the columns up to date with tree, and returns the root's column
+	// (a GPCaseColumnT of the root's return type). if execution throws, the
+	// cache is cleared before the exception is passed on.
+	const GPCaseColumn&	Update( const GPFunctionLookup& functions, const GPTree* tree, const GPCaseSelector& selector, int num_cases );
+
+	// replaces this cache with a copy of other's, where tree is a duplicate of
+	// other_tree. used when an individual is copied, so the copy starts warm.
+	void				CopyFrom( const GPCaseCache& other, const GPTree* other_tree, const GPTree* tree );
+
+	void				Clear();
+
+	// number of nodes recomputed by the last Update
+	int					GetNumRecomputed() const	{ return m_num_recomputed; }
+
+private:
+	GPCaseCache( const GPCaseCache& );
+	GPCaseCache& operator=( const GPCaseCache& );
+
+	typedef GPCaseColumn*(*CreateColumnSignature)( int num_cases );
+	typedef void(*CaseInvokeSignature)( const GPFunctionDesc& desc, GPCaseColumn& out, const GPCaseColumn* const* in );
+
+	struct Entry
+	{
+		GPFuncID			m_function;
+		const GPTreeNode*	m_parameters[ GP_MAX_PARAMETERS ];
+		GPCaseColumn*		m_column;
+		unsigned int		m_pass;
+	};
+
+	typedef std::map< const GPTreeNode*, Entry > EntryMap;
+
+	const GPCaseColumn*	UpdateNode( const GPFunctionLookup& functions, const GPTreeNode* node, const GPCaseSelector& selector, bool& recomputed );
+	void				CopyNode( const GPCaseCache& other, const GPTreeNode* other_node, const GPTreeNode* node );
+
+	EntryMap		m_entries;
+	unsigned int	m_pass;
+	int				m_num_cases;
+	int				m_num_recomputed;
+};
+
+#endif
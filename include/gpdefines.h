@@ -60,6 +60,12 @@ class	GPConstSubtreeIter;
 
 GPHash GPHashString( const char* string, int size );
 
+// random numbers for the library, 0 to 2^31 - 1. each thread has its own generator, so
+// threads breeding at once neither contend nor disturb each others' sequences. until a
+// thread seeds its generator with GPSeedRand, it is seeded from rand() on first use.
+int		GPRand();
+void	GPSeedRand( unsigned long long seed );
+
 // since templates dont expand for each typedef, but rather for
 // the types represented by the typedef, GPUNIQUE_TYPE macro
 // defines a type which acts as the base type.
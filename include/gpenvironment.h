@@ -28,19 +28,70 @@
 #include "gpdefines.h"
 #include "gpstats.h"
 #include "gpfunctionLookup.h"
+#include "gpcasecache.h"
+#include "gpfitnesscache.h"
+#include "gptreebuilder.h"
+#include <functional>
+#include <queue>
+#include <string>
 
 // some names for stats tracking
 #define GPS_BESTFITNESS		"BestFitness"
 #define GPS_AVGFITNESS		"AvgFitness"
 #define GPS_FAILEDXOVERS	"FailedCrossovers"
 #define GPS_TOTALXOVERS		"TotalCrossovers"
+#define GPS_FITNESSCACHEHITS	"FitnessCacheHits"
+#define GPS_FITNESSCACHEMISSES	"FitnessCacheMisses"
+#define GPS_BELOWCUTOFF		"EvaluationsBelowCutoff"
+#define GPS_BUDGETOVERRUNS	"BudgetOverruns"
+#define GPS_WORKERCRASHES	"WorkerCrashes"
+#define GPS_DUPLICATECHECKS	"DuplicateChecks"
+#define GPS_DUPLICATES		"Duplicates"
+#define GPS_DUPLICATESKEPT	"DuplicatesKept"
+
+class GPEvaluator;
+
+// how GenerateNewPopulation builds its trees (see GPTreeBuilder)
+enum GPInitMethod
+{
+	GP_INIT_GROW,	// every tree grown to at most the max depth
+	GP_INIT_FULL,	// every branch of every tree reaches the max depth
+	GP_INIT_RAMPED	// ramped half-and-half: equal numbers at each depth from min to max, half grown and half full
+};
+
+// the mutations breeding picks from (see SetMutationRate)
+enum GPMutation
+{
+	GP_MUTATE_SUBTREE,	// replace a random subtree with a new random one
+	GP_MUTATE_POINT,	// swap a node's function for another with the same parameters
+	GP_MUTATE_HOIST,	// make a random subtree of the tree's return type the whole tree
+	GP_MUTATE_SHRINK,	// replace a random subtree with a terminal
+
+	GP_NUM_MUTATIONS
+};
+
+// how breeding crosses two trees (see SetCrossover)
+enum GPCrossover
+{
+	GP_CROSSOVER_SUBTREE,		// a random subtree of the partner's, pruning the tree to make room
+	GP_CROSSOVER_SIZEFAIR,		// a subtree of the partner's sized relative to the one it replaces
+	GP_CROSSOVER_HOMOLOGOUS		// a subtree of the partner's from the same position, where the trees share shape
+};
+
+// objectives breeding can rank individuals on besides fitness (see SetSecondaryObjectives)
+enum GPObjective
+{
+	GP_OBJECTIVE_SIZE	= 1 << 0,	// fewer nodes in the tree
+	GP_OBJECTIVE_TIME	= 1 << 1	// less time taken by the fitness function
+};
 
 // ---------------------------------------------------------------------------
 // GPEnvironment
 //
-// This plays host to the population of individuals being trained. Necessarily
-// it also provides a place to register all the functions available as nodes
-// in the individuals. 
+// This plays host to the population of individuals being trained. The functions
+// available as nodes in the individuals live in a GPFunctionLookup, which is
+// either owned by the environment (filled out through RegisterFunction), or a
+// locked lookup shared between several environments (see ShareFunctions).
 //
 // Requiring at a minimum only a fitness function of specific signature, and
 // a host of registered functions it provides the mechanisms to generate,
@@ -50,24 +101,73 @@
 // TODO:
 //	- allow custom mutation and crossover functions
 //
-class GPEnvironment : public GPFunctionLookup
+class GPEnvironment
 {
+	friend class GPWorkerPool;
+	friend class GPEvaluationThreads;
+
 	typedef struct Individual
 	{
-		GPTree*		m_tree;
-		GPFitness	m_current_fitness;
+		GPTree*			m_tree;
+		GPFitness		m_current_fitness;
+
+		// only used with SetCaseFitnessFunction()
+		GPCaseCache*	m_case_cache;
+
+		// set whenever the tree changes, cleared once its fitness is known
+		bool			m_dirty;
+
+		// how long the fitness function took on the current tree, 0 if not known
+		double			m_evaluation_seconds;
+
+		// its row of the error matrix, only used with SetLexicaseSelection()
+		double*			m_case_errors;
 	};
 
 	//
 	// signature for a function which will execute an individual, 
 	// grade its output by calling the registered fitnes sfunction and
-	// return said fitness.
-	typedef GPFitness(GPEnvironment::*FitnessAndTestFunctionPtr)( int );
+	// return said fitness. the cutoff is only used by bounded fitness functions.
+	typedef GPFitness(GPEnvironment::*FitnessAndTestFunctionPtr)( int, GPFitness );
+
+	//
+	// signature of GPStaticFunctionSet<>::GetInvokePtr
+	typedef uintptr_t(*StaticInvokeLookupPtr)( GPTypeID );
+
+	//
+	// signature of the function making a fitness case current (see SetCaseFitnessFunction)
+	typedef void(*SelectCaseFuncPtr)( GPEnvironment&, const int );
+
+	// the best fitnesses known, for as many individuals as survive breeding. the worst is on top.
+	typedef std::priority_queue< GPFitness, std::vector< GPFitness >, std::greater< GPFitness > > FitnessHeap;
+
+	class CaseSelector : public GPCaseSelector
+	{
+	public:
+		CaseSelector( GPEnvironment& environment ) : m_environment( environment ) {}
+		void SelectCase( int case_index ) const { m_environment.m_select_case( m_environment, case_index ); }
+	private:
+		CaseSelector& operator=( const CaseSelector& );
+		GPEnvironment& m_environment;
+	};
 
 public:
 	GPEnvironment();
 	~GPEnvironment();
 
+	// registers a function with the environment's own lookup. takes the same parameters
+	// as the GPFunctionLookup::RegisterFunction() overloads. not valid once sharing.
+	template< class... Args >
+		GPFuncID RegisterFunction( const char* name, Args... args );
+
+	// use an already filled out lookup rather than registering functions on this
+	// environment. the lookup must be locked, so any number of environments (and
+	// threads) can read from it without synchronisation, and must outlive them.
+	void ShareFunctions( const GPFunctionLookup& functions );
+
+	// the functions the individuals are built from
+	const GPFunctionLookup& GetFunctions() const;
+
 	// let the environment know what type the individuals are expected to return
 	// used for not only constructing a population, but also its what the fitness
 	// functions is expected to accept.
@@ -79,13 +179,87 @@ public:
 	// number of individuals in this population (set this before calling GenerateNewPopulation)
 	void SetPopulationSize( int );
 
-	// makes a new population of completely random individuals
-	void GenerateNewPopulation();
+	// how GenerateNewPopulation builds trees, and the depths it builds them to. every tree
+	// is also held to the max tree size. defaults to GP_INIT_RAMPED from 2 to 6.
+	void SetInitialization( GPInitMethod method, int min_depth, int max_depth );
+
+	// makes a new population of completely random individuals. returns false, changing
+	// nothing, if the registered functions can't build a tree of the return type within
+	// the max tree size, and GetInitializationError() says why.
+	bool GenerateNewPopulation();
+	const char* GetInitializationError() const	{ return m_init_error.c_str(); }
+
+	// rejects trees built by GenerateNewPopulation which are structurally identical to
+	// another in the population, and offspring needing evaluation which are identical to
+	// one of their generation's parents, building them again up to retries times. the
+	// stats count the trees checked, the duplicates found, and those let through once the
+	// retries ran out. 0 (the default) allows duplicates.
+	void SetDuplicateRetries( int retries );
+
+	// each time breeding mutates a tree it picks one mutation, with chances in proportion
+	// to their rates. point and shrink mutations are cheap, and with hoist they keep trees
+	// from bloating. by default only GP_MUTATE_SUBTREE is used (at a rate of 1).
+	void SetMutationRate( GPMutation mutation, double rate );
+
+	// largest subtree GP_MUTATE_SUBTREE builds. 0 (the default) for any that fits the tree.
+	void SetSubtreeMutationSize( int max_nodes );
+
+	// the crossover breeding uses. size fair and homologous crossover never need to prune
+	// the tree to fit the donated subtree, and keep trees from bloating. defaults to
+	// GP_CROSSOVER_SUBTREE.
+	void SetCrossover( GPCrossover crossover );
+
+	// ranks individuals for breeding on fitness and the given GPObjective flags together,
+	// NSGA-II style (see GPRankNonDominated), rather than on fitness alone. so a smaller or
+	// quicker individual survives if nothing is better on every count, without penalties in
+	// the fitness function. untimed individuals are given a time by their size. there is no
+	// survival cutoff for bounded fitness functions while set. RunSteadyState still selects
+	// on fitness alone. 0 (the default) for fitness only.
+	void SetSecondaryObjectives( int objectives );
+
+	// keeps a matrix of num_cases errors for each individual, for the fitness function to
+	// fill in through SetCaseError alongside the fitness it returns, and breeds from parents
+	// picked by lexicase selection over it rather than by rank: each pick filters the whole
+	// population case by case, in a random order, down to those with the lowest error. with
+	// epsilon set, those within the median absolute deviation of the lowest are kept too,
+	// for errors which are rarely exactly equal. GP_KEEP slots still keep the fittest. there
+	// is no survival cutoff for bounded fitness functions, and no fitness cache, while set.
+	// the errors aren't passed back from evaluation workers. 0 cases (the default) turns it off.
+	void SetLexicaseSelection( int num_cases, bool epsilon );
+
+	// called from the fitness function, to record an individual's error on one of the cases
+	// (lower is better). the errors are reset whenever the individual's tree changes.
+	void SetCaseError( int index, int case_index, double error );
+
+	// an individual's row of num_cases errors, NULL unless SetLexicaseSelection is in use
+	const double* GetCaseErrors( int index ) const	{ return m_population[ index ].m_case_errors; }
 
 	// applies mutation and crossover to the existing population. this function assumes
 	// that every individual has already been tested and a fitness value has been stored.
+	// each offspring is bred from the population as it was before the call, so they can
+	// be bred on several threads (see SetBreedingThreads) with the same results.
 	void MutateAndCrossover();
 
+	// runs generations of MutateAndCrossover() and EvaluateAll(), calling callback (if given)
+	// once each generation is evaluated, and stopping early if it returns false. with
+	// evaluation threads or workers each offspring starts evaluating as soon as breeding is
+	// done with it, alongside the breeding of the rest, and while the last of a generation
+	// are evaluated the next is bred from the individuals already evaluated. that is redone
+	// wherever the final ranking differs, so the results are the same as without it. if the
+	// callback changes the population or a breeding setting, the next generation is bred
+	// again from scratch. the population is left evaluated.
+	// example callback signature:
+	//		bool GenerationDone( GPEnvironment&, const int generation )
+	void RunGenerations( int generations, bool(*callback)( GPEnvironment&, const int ) = NULL );
+
+	// steady-state alternative to looping EvaluateAll() and MutateAndCrossover(). num_threads
+	// threads each repeatedly breed an offspring from two parents picked by tournament, put
+	// it in place of the worst individual and evaluate it, without waiting for each other.
+	// returns once num_offspring have been bred. the fitness function (and select_case, if
+	// used) is called from several threads at once so must be thread safe. not for use
+	// with SetEvaluationWorkers.
+	void RunSteadyState( int num_offspring, int num_threads );
+
 	// optional tracking of statistics for each generation of individuals. call this function
 	// once per loop before the MutateAndCrossover() modifies the individuals.
 	void TrackStats();
@@ -101,6 +275,45 @@ public:
 		void SetFitnessFunction( GPFitness(*fitnessFunc)( GPEnvironment&, const int, const R& ) );
 	void SetFitnessFunction( GPFitness(*fitnessFunc)( GPEnvironment&, const int ) );
 
+	// alternative to SetFitnessFunction for fitness functions which execute the individual
+	// themselves, over a number of cases, and only ever lower the fitness as each case is
+	// added (ie: fitness is minus the total error). the environment passes the cutoff an
+	// individual has to beat for its tree to survive the next MutateAndCrossover, and the
+	// fitness function can give up and return as soon as its fitness falls below it.
+	// R is the type the individuals return. example signature:
+	//		GPFitness MeasureCases( GPEnvironment&, const int individual_index, const GPFitness cutoff )
+	template< class R >
+		void SetBoundedFitnessFunction( GPFitness(*fitnessFunc)( GPEnvironment&, const int, const GPFitness ) );
+
+	// alternative to SetFitnessFunction for fitness measured over a fixed set of cases.
+	// select_case is called to make each case current before the terminals read it, and
+	// the fitness function is handed the individual's result for every case at once.
+	// each node's results are cached (see GPCaseCache), so after breeding only the
+	// changed parts of a tree are re-executed. the functions must be pure.
+	// example signature:
+	//		GPFitness MeasureResults( GPEnvironment&, const int individual_index, const R* results, const int num_cases )
+	template< class R >
+		void SetCaseFitnessFunction( GPFitness(*fitnessFunc)( GPEnvironment&, const int, const R*, const int ), int num_cases, void(*select_case)( GPEnvironment&, const int ) );
+
+	// alternative to SetFitnessFunction for fitness measured somewhere else which answers
+	// later (ie: a simulator in another process). start is called to begin measuring an
+	// individual and must return straight away, then once the fitness is known pass it to
+	// CompleteFitness, from any thread. up to max_in_flight individuals are measured at
+	// once, and evaluation carries on submitting (and RunGenerations breeding) as results
+	// come back. the individual is left alone until completed, so start can send off its
+	// tree (see GetIndividualByIndex). R is the type the individuals return. example signature:
+	//		void StartMeasuring( GPEnvironment&, const int individual_index )
+	template< class R >
+		void SetAsyncFitnessFunction( void(*start)( GPEnvironment&, const int ), int max_in_flight );
+	void CompleteFitness( int index, GPFitness fitness );
+
+	// registers all the functions of a GPStaticFunctionSet<>, and from then on executes
+	// the individuals through the set's static dispatch rather than the invoke functions.
+	// use this instead of RegisterFunction(), not as well as it. if sharing functions,
+	// the shared lookup must have been filled out by FunctionSet::Register().
+	template< class FunctionSet >
+		void UseStaticFunctionSet();
+
 	// this is only valid after an individual has been Evaluate()'d
 	GPFitness		GetBestFitness() const;
 
@@ -117,9 +330,51 @@ public:
 	// returns the GPTree for the fittest individual
 	const GPTree*	GetIndividualByIndex( int idx ) const;
 
+	// evaluates only the individuals whose trees have changed since they were last evaluated
+	// (or every individual, see SetNoisyFitness). EvaluateIndividual always evaluates.
 	void		EvaluateAll();
 	GPFitness	EvaluateIndividual( int index );
 
+	// true until the individual's fitness is known (evaluated or overridden) for its current tree
+	bool		IsIndividualDirty( int index ) const;
+
+	// the fitness an individual has to beat for its tree to survive MutateAndCrossover, going
+	// by the individuals whose fitness is currently known. -max until enough are known.
+	GPFitness	GetSurvivalCutoff() const;
+
+	// for fitness functions which vary from run to run (ie: example2's random stick placement)
+	// so every individual is re-evaluated by EvaluateAll, and the fitness cache is bypassed.
+	void		SetNoisyFitness( bool noisy );
+
+	// remember the fitness of up to max_entries distinct trees, so any tree seen before
+	// is not executed again. only for deterministic fitness functions. 0 (the default)
+	// turns it off. hits and misses are counted in the stats.
+	void		SetFitnessCacheSize( int max_entries );
+
+	// limits each evaluation to max_steps node executions (see GPExecutionBudget), so
+	// individuals which loop forever or recurse too deeply can't hang the run. one that
+	// runs out is given the penalty fitness, and counted in the stats. 0 (the default)
+	// for no limit.
+	void		SetExecutionBudget( long max_steps, GPFitness penalty = -std::numeric_limits<double>::max() );
+
+	// evaluates individuals in num_workers forked processes (see GPWorkerPool) rather than
+	// in this one, for fitness functions which can't run on several threads. the workers are
+	// copies of the environment as it is now, so call this once everything else is set up.
+	// individuals which crash a worker get the budget penalty, and are counted in the stats.
+	// 0 (the default) evaluates in this process. returns false if processes are unsupported.
+	bool		SetEvaluationWorkers( int num_workers );
+
+	// evaluates individuals on num_threads threads (see GPEvaluationThreads), for fitness
+	// functions which are thread safe. replaces any evaluation workers. 0 (the default)
+	// evaluates on the calling thread. neither this nor SetEvaluationWorkers are for use
+	// with SetAsyncFitnessFunction.
+	void		SetEvaluationThreads( int num_threads );
+
+	// breeds the offspring in MutateAndCrossover() and RunGenerations(), and builds the
+	// trees in GenerateNewPopulation(), on num_threads threads. the results don't depend on
+	// the number of threads. 0 (the default) uses the calling thread.
+	void		SetBreedingThreads( int num_threads );
+
 	void		OverrideIndividualFitness( int index, GPFitness fitness );
 
 	template< class R >
@@ -132,19 +387,193 @@ public:
 
 private:
 	template< class R >
-		GPFitness EvaluateAndFitnessTest( int index );
+		GPFitness EvaluateAndFitnessTest( int index, GPFitness cutoff );
+
+	template< class R >
+		GPFitness EvaluateCasesAndFitnessTest( int index, GPFitness cutoff );
+
+	GPFitness EvaluateBoundedFitnessTest( int index, GPFitness cutoff );
+
+	GPFitness EvaluateIndividual( int index, GPFitness cutoff );
+
+	// runs the fitness function for an individual within the execution budget, and times it
+	GPFitness RunFitnessTest( int index, GPFitness cutoff, bool& overrun, double& seconds );
+
+	// stores a fitness just measured for an individual, counting it in the stats and cache
+	void RecordFitness( int index, GPFitness fitness, GPFitness cutoff, bool overrun, double seconds );
+
+	// rough time the fitness function will take on an individual, for scheduling
+	double EstimateEvaluationCost( const Individual& individual ) const;
+
+	// true if the individual's tree is in the fitness cache, which sets its fitness
+	bool FindCachedFitness( Individual& individual );
+
+	// waits for the next individual being evaluated by the evaluator, and returns its fitness
+	GPFitness CollectEvaluatorResult();
+
+	// evaluates an individual with the cutoff best_known gives, or hands it to the
+	// evaluator. any results collected meanwhile are added to best_known.
+	void QueueEvaluation( int index, FitnessHeap& best_known, int surviving );
+
+	// waits for everything handed to the evaluator
+	void FinishEvaluations( FitnessHeap& best_known, int surviving );
+
+	// the state Breed's threads share
+	struct BreedRun;
+	struct FitterIndividual;
+
+	// picks the seed a generation is bred from, and readies run for the population as it
+	// is now. ClearBreedRun does the same keeping the seed, dropping anything bred ahead.
+	void StartBreedRun( BreedRun& run );
+	void ClearBreedRun( BreedRun& run );
+
+	// MutateAndCrossover, which can queue each individual for evaluation once breeding
+	// is done with it. returns without waiting for the evaluations.
+	void Breed( BreedRun& run, bool evaluate );
+
+	// breeds whatever it can of the next generation from the individuals already evaluated,
+	// while the rest are still being evaluated. Breed keeps it where the ranking agrees.
+	void BreedAhead( BreedRun& run );
+	void BreedSlotAhead( BreedRun& run, int rank );
+
+	// a population of m_population_size empty individuals, and freeing one (which may be NULL)
+	Individual*	AllocatePopulation() const;
+	void		FreePopulation( Individual*& population );
+
+	// the state GenerateNewPopulation's threads share
+	struct GenerateRun;
+
+	void GenerateThread( GenerateRun& run );
+	void GenerateIndividual( const GenerateRun& run, int index );
+
+	// fills ranked with the individual indices, in the order they are bred from
+	void RankPopulation( std::vector< int >& ranked ) const;
+
+	// the number of leading ranks which survive breeding, for the bounded fitness cutoff.
+	// 0 when something other than rank picks the parents.
+	int CountSurvivors() const;
+
+	// picks a parent from those in run, by lexicase selection over their errors
+	int SelectByLexicase( const BreedRun& run ) const;
+
+	// points every individual in both buffers at its row of the error matrices
+	void AssignErrorRows();
+
+	void BreedThread( BreedRun& run );
+
+	// the parent and partner a rank is bred from under the ranking in run, -1 where unused
+	void FindSlotParents( const BreedRun& run, int rank, int& parent_index, int& partner_index ) const;
+
+	// produces the offspring for one rank, from the parents in run
+	void BreedSlot( BreedRun& run, int rank );
+
+	// makes offspring a copy of source, reusing offspring's tree and case cache
+	void CopyIntoOffspring( Individual& offspring, const Individual& source );
+
+	// true if the offspring just produced for a slot duplicates a parent, and should be
+	// produced again
+	bool RetryDuplicate( BreedRun& run, int index, int attempt );
+
+	// queues a produced offspring for evaluation, or adds its known fitness to run's best known.
+	// ones keeping their parent's tree are put in kept, to be queued once it is swapped in.
+	void ReleaseOffspring( BreedRun& run, int index, std::vector< int >& kept );
+
+	// called in a worker process. puts tree in place of the individual, and evaluates it
+	GPFitness EvaluateForWorker( int index, GPTree* tree, GPFitness cutoff, bool& overrun, double& seconds );
+
+	// executes a tree, through the static function set if one is in use
+	template< class R >
+		R ExecuteRoot( const GPTreeNode* root );
+
+	void UpdateStaticInvoke();
 
+	// StartAsyncFitness hands evaluation to a GPAsyncEvaluator, StopAsyncFitness goes back
+	// to running the fitness function in this process (if the async one was in use)
+	void StopAsyncFitness();
+	void StartAsyncFitness( void(*start)( GPEnvironment&, const int ), int max_in_flight );
+
+	// applies one mutation to tree, picked by the rates. returns whether it changed.
+	bool Mutate( GPTree* tree ) const;
+
+	// replaces part of tree with a copy of part of donor, using the crossover set. returns
+	// whether it changed.
+	bool Recombine( GPTree* tree, const GPTree* donor ) const;
+
+	// resets the fitness of an individual whose tree has been changed
+	void MarkDirty( Individual& individual );
+
+	// the state RunSteadyState's threads share
+	struct SteadyStateRun;
+
+	void SteadyStateThread( SteadyStateRun& run );
+	int  SelectByTournament( const SteadyStateRun& run ) const;
+
+	// the population is double buffered. MutateAndCrossover breeds into the back buffer
+	// from the front one and swaps them, so the trees are recycled rather than freed.
 	Individual					*m_population;
+	Individual					*m_back_population;
 	FitnessAndTestFunctionPtr	m_fitness_and_test_func;
 
 	// note: by storing the fitness function in a void*, it has to be global
 	// or on some compilers more complex function pointers wont fit.
 	void*			m_fitness_func;
 
+	// m_functions points at m_own_functions unless ShareFunctions() has been used
+	GPFunctionLookup			m_own_functions;
+	const GPFunctionLookup*		m_functions;
+
 	int				m_population_size;
 	int				m_max_tree_size;
 	GPTypeID		m_return_type;
 	GPStats			m_stats;
+	GPFitnessCache	m_fitness_cache;
+
+	StaticInvokeLookupPtr	m_static_invoke_lookup;
+	uintptr_t				m_static_invoke_ptr;
+
+	int					m_num_cases;
+	SelectCaseFuncPtr	m_select_case;
+
+	bool				m_noisy_fitness;
+
+	// the fitness function takes a cutoff
+	bool				m_bounded_fitness;
+
+	long				m_execution_budget;
+	GPFitness			m_budget_penalty;
+
+	// NULL unless SetEvaluationWorkers() or SetEvaluationThreads() has been used
+	GPEvaluator*		m_evaluator;
+	int					m_num_worker_processes;
+	bool				m_async_fitness;
+
+	// running average of evaluation time over tree size, 0 until something is timed
+	double				m_seconds_per_node;
+
+	int					m_breeding_threads;
+
+	GPInitMethod		m_init_method;
+	int					m_init_min_depth;
+	int					m_init_max_depth;
+	std::string			m_init_error;
+
+	int					m_duplicate_retries;
+
+	double				m_mutation_rates[ GP_NUM_MUTATIONS ];
+	int					m_subtree_mutation_size;
+
+	GPCrossover			m_crossover;
+	int					m_objectives;
+
+	// with lexicase selection, the error matrix of each buffer, m_lexicase_cases to a row
+	int					m_lexicase_cases;
+	bool				m_epsilon_lexicase;
+	std::vector< double >	m_error_matrix;
+	std::vector< double >	m_back_error_matrix;
+
+	// counts the calls changing the population or how it is bred, so RunGenerations can
+	// tell when what it bred ahead is out of date
+	unsigned int		m_changes;
 };
 
 template< class R >
@@ -152,24 +581,134 @@ void GPEnvironment::SetFitnessFunction( GPFitness(*fitnessFunc)( GPEnvironment&,
 {
 	m_return_type = GPGetTypeID< R >();
 	m_fitness_and_test_func = &GPEnvironment::EvaluateAndFitnessTest< R >;
+	m_bounded_fitness = false;
 
 	// TODO: assert that the void* can take the size of this pointer
 	m_fitness_func = reinterpret_cast<void*>(fitnessFunc);
+
+	StopAsyncFitness();
+	m_fitness_cache.Clear();
+	UpdateStaticInvoke();
+	++m_changes;
+}
+
+template< class R >
+void GPEnvironment::SetCaseFitnessFunction( GPFitness(*fitnessFunc)( GPEnvironment&, const int, const R*, const int ), int num_cases, void(*select_case)( GPEnvironment&, const int ) )
+{
+	m_return_type = GPGetTypeID< R >();
+	m_fitness_and_test_func = &GPEnvironment::EvaluateCasesAndFitnessTest< R >;
+	m_bounded_fitness = false;
+
+	m_fitness_func	= reinterpret_cast<void*>(fitnessFunc);
+	m_num_cases		= num_cases;
+	m_select_case	= select_case;
+
+	StopAsyncFitness();
+	m_fitness_cache.Clear();
+	UpdateStaticInvoke();
+	++m_changes;
+}
+
+template< class R >
+void GPEnvironment::SetBoundedFitnessFunction( GPFitness(*fitnessFunc)( GPEnvironment&, const int, const GPFitness ) )
+{
+	m_return_type = GPGetTypeID< R >();
+	m_fitness_and_test_func = &GPEnvironment::EvaluateBoundedFitnessTest;
+	m_bounded_fitness = true;
+
+	m_fitness_func = reinterpret_cast<void*>(fitnessFunc);
+
+	StopAsyncFitness();
+	m_fitness_cache.Clear();
+	UpdateStaticInvoke();
+	++m_changes;
+}
+
+template< class R >
+void GPEnvironment::SetAsyncFitnessFunction( void(*start)( GPEnvironment&, const int ), int max_in_flight )
+{
+	m_return_type = GPGetTypeID< R >();
+	m_fitness_and_test_func = NULL;
+	m_bounded_fitness = false;
+	m_fitness_func = NULL;
+
+	m_fitness_cache.Clear();
+	UpdateStaticInvoke();
+	++m_changes;
+	StartAsyncFitness( start, max_in_flight );
+}
+
+template< class... Args >
+GPFuncID GPEnvironment::RegisterFunction( const char* name, Args... args )
+{
+	// if this assert fires functions are being registered with an environment which is
+	// sharing someone else's lookup. register them on the shared lookup before locking it.
+	assert( m_functions == &m_own_functions );
+
+	++m_changes;
+	return m_own_functions.RegisterFunction( name, args... );
+}
+
+inline const GPFunctionLookup& GPEnvironment::GetFunctions() const
+{
+	return *m_functions;
+}
+
+template< class FunctionSet >
+void GPEnvironment::UseStaticFunctionSet()
+{
+	if ( m_functions == &m_own_functions )
+	{
+		FunctionSet::Register( m_own_functions );
+	}
+
+	m_static_invoke_lookup = &FunctionSet::GetInvokePtr;
+	UpdateStaticInvoke();
+}
+
+template< class R >
+R GPEnvironment::ExecuteRoot( const GPTreeNode* root )
+{
+	typedef R(*InvokeFuncSignature)( const GPFunctionLookup& functions, const GPTreeNode& f );
+
+	if ( m_static_invoke_ptr )
+	{
+		InvokeFuncSignature invoke_func = reinterpret_cast< InvokeFuncSignature >( m_static_invoke_ptr );
+		return invoke_func( *m_functions, *root );
+	}
+
+	return ExecuteTree< R >( *m_functions, root );
 }
 
 // We need both a general version of EvaluateAndFitness test for the case when
 // the fitness function is expecting some kind of parameter
 // as well as the case where the GP is is returning void.
 template< class R >
-GPFitness GPEnvironment::EvaluateAndFitnessTest( int index )
+GPFitness GPEnvironment::EvaluateAndFitnessTest( int index, GPFitness )
 {
 	typedef GPFitness(*FitnessFunc)( GPEnvironment&, const int, const R& );
 	FitnessFunc custom_function = reinterpret_cast< FitnessFunc >( m_fitness_func );
-	return custom_function( *this, index, ExecuteTree< R >( *this, m_population[ index ].m_tree->Root() ) );
+	return custom_function( *this, index, ExecuteRoot< R >( m_population[ index ].m_tree->Root() ) );
 }
 
 template<>
-GPFitness GPEnvironment::EvaluateAndFitnessTest<void>( int index );
+GPFitness GPEnvironment::EvaluateAndFitnessTest<void>( int index, GPFitness );
+
+template< class R >
+GPFitness GPEnvironment::EvaluateCasesAndFitnessTest( int index, GPFitness )
+{
+	typedef GPFitness(*FitnessFunc)( GPEnvironment&, const int, const R*, const int );
+	FitnessFunc custom_function = reinterpret_cast< FitnessFunc >( m_fitness_func );
+
+	Individual& individual = m_population[ index ];
+	if ( individual.m_case_cache == NULL )
+	{
+		individual.m_case_cache = new GPCaseCache();
+	}
+
+	const GPCaseColumn& results = individual.m_case_cache->Update( *m_functions, individual.m_tree, CaseSelector( *this ), m_num_cases );
+	return custom_function( *this, index, static_cast< const GPCaseColumnT< R >& >( results ).Values(), m_num_cases );
+}
 
 template< class R >
 R GPEnvironment::ExecuteIndividual( int index )
@@ -177,7 +716,7 @@ R GPEnvironment::ExecuteIndividual( int index )
 	// if this assert fires, the caller is asking for a type other than what the current
 	// population are expected to be returning.
 	assert( GPGetTypeID< R >() == m_return_type );
-	return ExecuteTree< R >( *this, m_population[ index ].m_tree->Root() );
+	return ExecuteRoot< R >( m_population[ index ].m_tree->Root() );
 }
 
 
@@ -0,0 +1,199 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPEVALUATOR_H
+#define GPEVALUATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "gpdefines.h"
+#include "gptree.h"
+
+class GPEnvironment;
+
+// ---------------------------------------------------------------------------
+// GPEvaluator
+//
+// Evaluates individuals somewhere other than on the calling thread, so the
+// caller can carry on (ie: breeding) while they run. The environment submits
+// an individual once nothing else will touch it, and collects the fitness
+// once it is done, storing it and keeping the stats and cache up to date.
+//
+class GPEvaluator
+{
+public:
+	struct Result
+	{
+		int			m_index;
+		GPFitness	m_cutoff;
+		GPFitness	m_fitness;
+		bool		m_overrun;
+		bool		m_crashed;
+
+		// how long the fitness function took, 0 if unknown
+		double		m_seconds;
+	};
+
+	virtual ~GPEvaluator() {}
+
+	virtual int		GetNumWorkers() const = 0;
+	virtual bool	HasIdleWorker() const = 0;
+	virtual int		GetNumOutstanding() const = 0;
+
+	// hands individual index (with the given tree) to an idle worker
+	virtual void	Submit( int index, const GPTree* tree, GPFitness cutoff ) = 0;
+
+	// waits for any submitted individual to finish. only valid if some are outstanding.
+	virtual Result	Collect() = 0;
+};
+
+// ---------------------------------------------------------------------------
+// GPEvaluationThreads
+//
+// Evaluates individuals on a set of threads in this process. Each thread
+// executes the individual's tree where it is in the population, so the
+// environment leaves an individual alone until it has been collected.
+//
+// Jobs are dealt out round-robin to a queue per thread. A thread works from
+// the front of its own queue, and once that is empty steals from the back of
+// the others'. The environment submits the costliest individuals first, so
+// the big trees are started first and the small ones fill the gaps.
+//
+// Used through GPEnvironment::SetEvaluationThreads, which owns the threads.
+//
+// Limitations:
+//	* The fitness function (and select_case, if used) is called on several
+//	  threads at once, so must be thread safe.
+//
+class GPEvaluationThreads : public GPEvaluator
+{
+public:
+	GPEvaluationThreads();
+	~GPEvaluationThreads();
+
+	void	Start( GPEnvironment& environment, int num_threads );
+	void	Stop();
+
+	int		GetNumWorkers() const		{ return static_cast< int >( m_threads.size() ); }
+	bool	HasIdleWorker() const;
+	int		GetNumOutstanding() const;
+
+	void	Submit( int index, const GPTree* tree, GPFitness cutoff );
+	Result	Collect();
+
+private:
+	GPEvaluationThreads( const GPEvaluationThreads& );
+	GPEvaluationThreads& operator=( const GPEvaluationThreads& );
+
+	struct Job
+	{
+		int			m_index;
+		GPFitness	m_cutoff;
+	};
+
+	struct JobQueue
+	{
+		std::mutex			m_lock;
+		std::deque< Job >	m_jobs;
+	};
+
+	void	ThreadMain( int thread );
+	bool	TakeJob( int thread, Job& job );
+
+	GPEnvironment*				m_environment;
+	std::vector< std::thread >	m_threads;
+
+	// one per thread. queues hold a mutex, so can't be moved once created
+	std::vector< JobQueue* >	m_queues;
+	int							m_next_queue;
+
+	// a job is counted as running before it stops being queued, and it stops running
+	// under m_lock in the same step that stores its result, so the outstanding count
+	// never drops before Collect() can take the result
+	std::atomic< int >			m_num_queued;
+	std::atomic< int >			m_num_running;
+
+	// everything below is guarded by m_lock
+	mutable std::mutex			m_lock;
+	std::condition_variable		m_job_added;
+	std::condition_variable		m_result_added;
+	std::deque< Result >		m_results;
+	bool						m_stopping;
+};
+
+// ---------------------------------------------------------------------------
+// GPAsyncEvaluator
+//
+// Hands individuals to a user function which starts measuring them somewhere
+// else (ie: a simulator in another process) and returns straight away. The
+// fitness is handed back later through Complete(), from any thread. At most
+// max_in_flight individuals are being measured at once.
+//
+// Used through GPEnvironment::SetAsyncFitnessFunction, which owns it.
+//
+class GPAsyncEvaluator : public GPEvaluator
+{
+public:
+	typedef void(*StartFuncPtr)( GPEnvironment&, const int );
+
+	GPAsyncEvaluator( GPEnvironment& environment, StartFuncPtr start, int max_in_flight );
+
+	int		GetNumWorkers() const		{ return m_max_in_flight; }
+	bool	HasIdleWorker() const;
+	int		GetNumOutstanding() const;
+
+	void	Submit( int index, const GPTree* tree, GPFitness cutoff );
+	Result	Collect();
+
+	// the fitness of an individual passed to the start function. callable from any thread.
+	void	Complete( int index, GPFitness fitness );
+
+private:
+	GPAsyncEvaluator( const GPAsyncEvaluator& );
+	GPAsyncEvaluator& operator=( const GPAsyncEvaluator& );
+
+	struct Request
+	{
+		GPFitness								m_cutoff;
+		std::chrono::steady_clock::time_point	m_start;
+	};
+
+	GPEnvironment&				m_environment;
+	StartFuncPtr				m_start;
+	int							m_max_in_flight;
+
+	// everything below is guarded by m_lock
+	mutable std::mutex			m_lock;
+	std::condition_variable		m_result_added;
+	std::map< int, Request >	m_in_flight;
+	std::deque< Result >		m_results;
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPFITNESSCACHE_H
+#define GPFITNESSCACHE_H
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "gpdefines.h"
+#include "gptree.h"
+
+// ---------------------------------------------------------------------------
+// GPFitnessCache
+//
+// Remembers the fitness of trees by their structure, so a tree which has been
+// evaluated before (a copy, a regenerated GP_NEW, a crossover that swapped
+// identical subtrees) need not be executed again.
+//
+// Trees are keyed by their preorder sequence of function IDs, which identifies
+// the structure exactly since every function has a fixed number of parameters.
+// The key is hashed for lookup, but compared in full, so there are no false hits.
+// Once full, the least recently used entry is evicted.
+//
+// Limitations:
+//	* Only valid for deterministic fitness functions.
+//
+class GPFitnessCache
+{
+public:
+	GPFitnessCache();
+
+	// 0 turns the cache off. shrinking evicts the least recently used entries.
+	void	SetMaxEntries( int max_entries );
+	int		GetMaxEntries() const	{ return m_max_entries; }
+	bool	IsEnabled() const		{ return m_max_entries > 0; }
+
+	// returns true and the cached fitness if tree has been seen before
+	bool	Find( const GPTree* tree, GPFitness& fitness );
+	void	Store( const GPTree* tree, GPFitness fitness );
+
+	void	Clear();
+
+private:
+	struct Key
+	{
+		std::vector< GPFuncID >	m_functions;
+		GPHash					m_hash;
+
+		bool operator==( const Key& other ) const
+		{
+			return m_hash == other.m_hash && m_functions == other.m_functions;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()( const Key& key ) const	{ return key.m_hash; }
+	};
+
+	// most recently used at the front. keys in the map never move, so the list can point at them
+	typedef std::list< const Key* > UsageList;
+
+	struct Entry
+	{
+		GPFitness			m_fitness;
+		UsageList::iterator	m_usage;
+	};
+
+	typedef std::unordered_map< Key, Entry, KeyHash > EntryMap;
+
+	void	MakeKey( const GPTree* tree );
+	void	Evict( int max_entries );
+
+	EntryMap	m_entries;
+	UsageList	m_usage;
+	int			m_max_entries;
+
+	// reused between lookups to save reallocating the sequence every time
+	Key			m_key;
+};
+
+#endif
@@ -26,6 +26,8 @@
 #define GPFUNCTIONLOOKUP_H
 
 #include <string.h>
+#include <limits>
+#include <new>
 #include "gptree.h"
 
 class GPMemberPointerExamples
@@ -70,6 +72,13 @@ typedef struct GPFunctionDescType
 	// we will be delaying is.
 	GPFuncID m_original_function_id;
 
+	// column-at-a-time versions used by GPCaseCache. the invoke is 0 for functions
+	// without parameters or with delayed ones, which are executed case by case.
+	uintptr_t m_case_invoke_ptr;
+
+	// GPCaseColumnT< return type >::Create, or 0 for void (and reference) returns
+	uintptr_t m_case_column_ptr;
+
 	char m_debug_name[GP_DEBUGNAME_LEN];
 
 	GPFunctionDescType()
@@ -80,6 +89,8 @@ typedef struct GPFunctionDescType
 		m_nparams			= 0;
 		m_return_type		= GP_INVALID_PARAMTYPE;
 		m_member_owner		= NULL;
+		m_case_invoke_ptr	= 0;
+		m_case_column_ptr	= 0;
 		m_debug_name[0]		= '\0';
 
 		m_original_function_id = -1;
@@ -98,6 +109,10 @@ typedef struct GPFunctionDescType
 // A registry for C++ functions. Allows some lookups such as being able
 // to find a function with a specified return type.
 //
+// Once every function is registered the lookup can be locked. A locked
+// lookup never changes again, so it can be shared by any number of
+// GPEnvironments (on any number of threads) with no synchronisation.
+//
 class GPFunctionLookup
 {
 public:
@@ -106,8 +121,14 @@ public:
 	GPFunctionLookup()
 	{
 		m_nFuncs = 0;
+		m_locked = false;
 	}
 
+	// no further functions may be registered after this. RegisterFunction asserts, and
+	// in release builds leaves the lookup alone and returns NULLFUNC.
+	void Lock()				{ m_locked = true; }
+	bool IsLocked() const	{ return m_locked; }
+
 	// 0 params
 	template< class R >
 		GPFuncID RegisterFunction( const char* name, R (*myFunc)() );
@@ -145,15 +166,15 @@ public:
 	GPFuncID GetRandomFuncWithReturnType( GPTypeID return_type_id ) const;
 	GPFuncID GetNextFuncWithReturnType( GPTypeID return_type_id, GPFuncID previous ) const;
 
-
-private:
-
 	int GetNumFunctions() const
 	{
 		return m_nFuncs;
 	}
 
+private:
+
 	int m_nFuncs;
+	bool m_locked;
 	GPFunctionDesc m_functions[ GP_MAX_FUNCTIONS * 2 ]; // double because there will be a 'delayed' version of each function too
 
 };
@@ -163,6 +184,43 @@ inline const bool GPFunctionLookup::FunctionIDExists( const GPFuncID id ) const
 	return id < GetNumFunctions();
 }
 
+// ---------------------------------------------------------------------------
+// GPExecutionBudget
+//
+// Bounds the number of steps executed on the calling thread. Every node
+// invoked and every GPDelayedEvaluation::Evaluate() takes a step, and once
+// they run out GPBudgetExceeded is thrown, unwinding out of the tree however
+// deeply nested (or looping) it is.
+//
+// GPEnvironment sets a budget around each evaluation (SetExecutionBudget), and
+// turns the exception into a penalty fitness. Anyone executing trees directly
+// can do the same. Unlimited unless set.
+//
+struct GPBudgetExceeded
+{
+};
+
+class GPExecutionBudget
+{
+public:
+	// 0 for unlimited
+	static void Set( long steps )
+	{
+		s_remaining = steps > 0 ? steps : std::numeric_limits< long >::max();
+	}
+
+	static void Step()
+	{
+		if ( --s_remaining < 0 )
+		{
+			throw GPBudgetExceeded();
+		}
+	}
+
+private:
+	static thread_local long s_remaining;
+};
+
 // ---------------------------------------------------------------------------
 // GPDelayedEvaluation
 //
@@ -178,14 +236,31 @@ template< class R >
 class GPDelayedEvaluation
 {
 public:
+	typedef R(*EvaluatorSignature)( const GPFunctionLookup& functions, const GPTreeNode& f );
+	typedef R(*StandaloneSignature)();
+
 	GPDelayedEvaluation( const GPFunctionLookup& functions, const GPTreeNode& f  )
-		: m_functions( functions ), m_treenode( f )
+		: m_functions( &functions ), m_treenode( &f ), m_evaluator( NULL ), m_standalone( NULL )
+	{ }
+
+	// the evaluator is called in place of the invoke function registered for the
+	// node. used by GPStaticFunctionSet so delayed branches keep static dispatch.
+	GPDelayedEvaluation( const GPFunctionLookup& functions, const GPTreeNode& f, EvaluatorSignature evaluator )
+		: m_functions( &functions ), m_treenode( &f ), m_evaluator( evaluator ), m_standalone( NULL )
+	{ }
+
+	// evaluates a plain function rather than a tree node. this is how code exported
+	// with ExportTreeCpp() passes delayed parameters (see GPMakeDelayedEvaluation).
+	explicit GPDelayedEvaluation( StandaloneSignature standalone )
+		: m_functions( NULL ), m_treenode( NULL ), m_evaluator( NULL ), m_standalone( standalone )
 	{ }
 
 	R Evaluate() const;
 private:
-	const GPFunctionLookup& m_functions;
-	const GPTreeNode&		m_treenode;
+	const GPFunctionLookup*	m_functions;
+	const GPTreeNode*		m_treenode;
+	EvaluatorSignature		m_evaluator;
+	StandaloneSignature		m_standalone;
 };
 
 template< class R >
@@ -193,9 +268,27 @@ R GPDelayedEvaluation< R >::Evaluate() const
 {
 	typedef R(*InvokeFuncSignature)( const GPFunctionLookup& functions, const GPTreeNode& f);
 
-	GPFuncID original_function_id = m_functions.GetFunctionByID( m_treenode.functionID ).m_original_function_id;
-	InvokeFuncSignature invoke_func = reinterpret_cast< InvokeFuncSignature >( m_functions.GetFunctionByID( original_function_id ).m_invoke_ptr );
-	return invoke_func( m_functions, m_treenode );
+	GPExecutionBudget::Step();
+
+	if ( m_evaluator )
+	{
+		return m_evaluator( *m_functions, *m_treenode );
+	}
+
+	if ( m_standalone )
+	{
+		return m_standalone();
+	}
+
+	GPFuncID original_function_id = m_functions->GetFunctionByID( m_treenode->functionID ).m_original_function_id;
+	InvokeFuncSignature invoke_func = reinterpret_cast< InvokeFuncSignature >( m_functions->GetFunctionByID( original_function_id ).m_invoke_ptr );
+	return invoke_func( *m_functions, *m_treenode );
+}
+
+template< class R >
+GPDelayedEvaluation< R > GPMakeDelayedEvaluation( R (*standalone)() )
+{
+	return GPDelayedEvaluation< R >( standalone );
 }
 
 template< class P >
@@ -229,6 +322,7 @@ GPDelayedEvaluation< R > GPDelayedInvokeFunction( const GPFunctionLookup& functi
 template< class R >
 R GPInvokeFunction0( const GPFunctionLookup& functions, const GPTreeNode& f )
 {
+	GPExecutionBudget::Step();
 	typedef R(*WrappedFunctionSignature)();
 	WrappedFunctionSignature function_ptr;
 	memcpy( &function_ptr, functions.GetFunctionByID( f.functionID ).m_function_ptr, sizeof( WrappedFunctionSignature ) );
@@ -238,6 +332,7 @@ R GPInvokeFunction0( const GPFunctionLookup& functions, const GPTreeNode& f )
 template< class C, class R >
 R GPInvokeMemberFunction0( const GPFunctionLookup& functions, const GPTreeNode& f )
 {
+	GPExecutionBudget::Step();
 	typedef R(C::*WrappedFunctionSignature)();
 	const GPFunctionDesc& desc = functions.GetFunctionByID( f.functionID );
 	WrappedFunctionSignature function_ptr;
@@ -249,6 +344,7 @@ R GPInvokeMemberFunction0( const GPFunctionLookup& functions, const GPTreeNode&
 template< class R, class P1 >
 R GPInvokeFunction1( const GPFunctionLookup& functions, const GPTreeNode& f)
 {
+	GPExecutionBudget::Step();
 	typedef R(*WrappedFunctionSignature)(P1);
 	typedef P1(*Param1InvokeSignature)( const GPFunctionLookup& , const GPTreeNode& );
 	const GPFunctionDesc& desc = functions.GetFunctionByID( f.functionID );
@@ -264,6 +360,7 @@ R GPInvokeFunction1( const GPFunctionLookup& functions, const GPTreeNode& f)
 template< class C, class R, class P1 >
 R GPInvokeMemberFunction1( const GPFunctionLookup& functions, const GPTreeNode& f)
 {
+	GPExecutionBudget::Step();
 	typedef R(C::*WrappedFunctionSignature)(P1);
 	typedef P1(*Param1InvokeSignature)( const GPFunctionLookup& , const GPTreeNode& );
 	const GPFunctionDesc& desc = functions.GetFunctionByID( f.functionID );
@@ -280,6 +377,7 @@ R GPInvokeMemberFunction1( const GPFunctionLookup& functions, const GPTreeNode&
 template< class R, class P1, class P2 >
 R GPInvokeFunction2( const GPFunctionLookup& functions, const GPTreeNode& f )
 {
+	GPExecutionBudget::Step();
 	typedef P1(*Param1InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef P2(*Param2InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R(*WrappedFunctionSignature)(P1,P2);
@@ -298,6 +396,7 @@ R GPInvokeFunction2( const GPFunctionLookup& functions, const GPTreeNode& f )
 template< class C, class R, class P1, class P2 >
 R GPInvokeMemberFunction2( const GPFunctionLookup& functions, const GPTreeNode& f )
 {
+	GPExecutionBudget::Step();
 	typedef P1(*Param1InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef P2(*Param2InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R(C::*WrappedFunctionSignature)(P1,P2);
@@ -316,6 +415,7 @@ R GPInvokeMemberFunction2( const GPFunctionLookup& functions, const GPTreeNode&
 template< class R, class P1, class P2, class P3 >
 R GPInvokeFunction3( const GPFunctionLookup& functions, const GPTreeNode& f )
 {
+	GPExecutionBudget::Step();
 	typedef P1(*Param1InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef P2(*Param2InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef P3(*Param3InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
@@ -337,6 +437,7 @@ R GPInvokeFunction3( const GPFunctionLookup& functions, const GPTreeNode& f )
 template< class C, class R, class P1, class P2, class P3 >
 R GPInvokeMemberFunction3( const GPFunctionLookup& functions, const GPTreeNode& f )
 {
+	GPExecutionBudget::Step();
 	typedef P1(*Param1InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef P2(*Param2InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef P3(*Param3InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
@@ -356,6 +457,258 @@ R GPInvokeMemberFunction3( const GPFunctionLookup& functions, const GPTreeNode&
 		);
 }
 
+// ---------------------------------------------------------------------------
+// GPCaseColumn
+//
+// The output of one node over every fitness case, as kept by GPCaseCache.
+// Values are copy constructed in place, so R need not be default constructible.
+//
+class GPCaseSelector
+{
+public:
+	// makes case_index the case the tree's terminals read from
+	virtual void SelectCase( int case_index ) const = 0;
+
+protected:
+	~GPCaseSelector() {}
+};
+
+class GPCaseColumn
+{
+public:
+	virtual ~GPCaseColumn() {}
+
+	virtual GPCaseColumn* Clone() const = 0;
+
+	// fills the column by selecting each case in turn and executing the subtree at node
+	virtual void ExecuteCases( const GPFunctionLookup& functions, const GPTreeNode& node, const GPCaseSelector& selector ) = 0;
+};
+
+template< class R >
+class GPCaseColumnT : public GPCaseColumn
+{
+public:
+	static GPCaseColumn* Create( int num_cases )
+	{
+		return new GPCaseColumnT< R >( num_cases );
+	}
+
+	GPCaseColumnT( int num_cases )
+		: m_num_cases( num_cases ), m_num_filled( 0 )
+	{
+		m_values = static_cast< R* >( ::operator new( sizeof( R ) * num_cases ) );
+	}
+
+	~GPCaseColumnT()
+	{
+		Clear();
+		::operator delete( m_values );
+	}
+
+	GPCaseColumn* Clone() const
+	{
+		GPCaseColumnT< R >* clone = new GPCaseColumnT< R >( m_num_cases );
+		if ( m_num_filled == m_num_cases )
+		{
+			const R* values = m_values;
+			clone->Fill( [values]( int c ) -> const R& { return values[ c ]; } );
+		}
+		return clone;
+	}
+
+	void ExecuteCases( const GPFunctionLookup& functions, const GPTreeNode& node, const GPCaseSelector& selector )
+	{
+		typedef R(*InvokeFuncSignature)( const GPFunctionLookup& functions, const GPTreeNode& f );
+		InvokeFuncSignature invoke_func = reinterpret_cast< InvokeFuncSignature >( functions.GetFunctionByID( node.functionID ).m_invoke_ptr );
+
+		Fill( [&]( int c ) -> R { selector.SelectCase( c ); return invoke_func( functions, node ); } );
+	}
+
+	// generate( case_index ) is called once per case, in order. if it throws
+	// (ie: GPBudgetExceeded) the column is left holding only the cases done so far.
+	template< class Generator >
+	void Fill( Generator generate )
+	{
+		Clear();
+		for( ; m_num_filled < m_num_cases; ++m_num_filled )
+		{
+			new ( &m_values[ m_num_filled ] ) R( generate( m_num_filled ) );
+		}
+	}
+
+	const R*	Values() const		{ return m_values; }
+	int			Count() const		{ return m_num_cases; }
+
+private:
+	GPCaseColumnT( const GPCaseColumnT& );
+	GPCaseColumnT& operator=( const GPCaseColumnT& );
+
+	void Clear()
+	{
+		for( int c = 0; c < m_num_filled; ++c )
+		{
+			m_values[ c ].~R();
+		}
+		m_num_filled = 0;
+	}
+
+	R*		m_values;
+	int		m_num_cases;
+	int		m_num_filled;
+};
+
+// ---------------------------------------------------------------------------
+// GPCaseInvokeFunction and GPCaseInvokeMemberFunction
+//
+// Column-at-a-time counterparts of the invoke functions. Rather than pulling
+// its parameters from the child nodes, the wrapped function is called once per
+// case with the values from the children's columns.
+//
+// Only needed for functions taking parameters, and only possible when none of
+// them are delayed and the result can be held in a column (not void or a
+// reference) - GPCaseCache executes every other node case by case.
+//
+template< class P >
+struct GPCaseCacheable
+{
+	static const bool value = true;
+};
+
+template< class P >
+struct GPCaseCacheable< GPDelayedEvaluation< P > >
+{
+	static const bool value = false;
+};
+
+template<>
+struct GPCaseCacheable< void >
+{
+	static const bool value = false;
+};
+
+template< class P >
+struct GPCaseCacheable< P& >
+{
+	static const bool value = false;
+};
+
+template< bool Cacheable, class Wrapper >
+struct GPCaseInvokePtr
+{
+	static uintptr_t Get() { return reinterpret_cast< uintptr_t >( &Wrapper::Invoke ); }
+};
+
+template< class Wrapper >
+struct GPCaseInvokePtr< false, Wrapper >
+{
+	static uintptr_t Get() { return 0; }
+};
+
+template< class R, bool Cacheable = GPCaseCacheable< R >::value >
+struct GPCaseColumnPtr
+{
+	static uintptr_t Get() { return reinterpret_cast< uintptr_t >( &GPCaseColumnT< R >::Create ); }
+};
+
+template< class R >
+struct GPCaseColumnPtr< R, false >
+{
+	static uintptr_t Get() { return 0; }
+};
+
+template< class P >
+const P* GPCaseValues( const GPCaseColumn* column )
+{
+	return static_cast< const GPCaseColumnT< P >* >( column )->Values();
+}
+
+template< class R, class P1 >
+struct GPCaseInvokeFunction1
+{
+	static void Invoke( const GPFunctionDesc& desc, GPCaseColumn& out, const GPCaseColumn* const* in )
+	{
+		typedef R(*WrappedFunctionSignature)(P1);
+		WrappedFunctionSignature function_ptr;
+		memcpy( &function_ptr, desc.m_function_ptr, sizeof( WrappedFunctionSignature ) );
+		const P1* p1 = GPCaseValues< P1 >( in[0] );
+		static_cast< GPCaseColumnT< R >& >( out ).Fill( [&]( int c ) -> R { return function_ptr( p1[c] ); } );
+	}
+};
+
+template< class C, class R, class P1 >
+struct GPCaseInvokeMemberFunction1
+{
+	static void Invoke( const GPFunctionDesc& desc, GPCaseColumn& out, const GPCaseColumn* const* in )
+	{
+		typedef R(C::*WrappedFunctionSignature)(P1);
+		WrappedFunctionSignature function_ptr;
+		memcpy( &function_ptr, desc.m_function_ptr, sizeof( WrappedFunctionSignature ) );
+		C* classptr = reinterpret_cast< C* >( desc.m_member_owner );
+		const P1* p1 = GPCaseValues< P1 >( in[0] );
+		static_cast< GPCaseColumnT< R >& >( out ).Fill( [&]( int c ) -> R { return (classptr->*function_ptr)( p1[c] ); } );
+	}
+};
+
+template< class R, class P1, class P2 >
+struct GPCaseInvokeFunction2
+{
+	static void Invoke( const GPFunctionDesc& desc, GPCaseColumn& out, const GPCaseColumn* const* in )
+	{
+		typedef R(*WrappedFunctionSignature)(P1,P2);
+		WrappedFunctionSignature function_ptr;
+		memcpy( &function_ptr, desc.m_function_ptr, sizeof( WrappedFunctionSignature ) );
+		const P1* p1 = GPCaseValues< P1 >( in[0] );
+		const P2* p2 = GPCaseValues< P2 >( in[1] );
+		static_cast< GPCaseColumnT< R >& >( out ).Fill( [&]( int c ) -> R { return function_ptr( p1[c], p2[c] ); } );
+	}
+};
+
+template< class C, class R, class P1, class P2 >
+struct GPCaseInvokeMemberFunction2
+{
+	static void Invoke( const GPFunctionDesc& desc, GPCaseColumn& out, const GPCaseColumn* const* in )
+	{
+		typedef R(C::*WrappedFunctionSignature)(P1,P2);
+		WrappedFunctionSignature function_ptr;
+		memcpy( &function_ptr, desc.m_function_ptr, sizeof( WrappedFunctionSignature ) );
+		C* classptr = reinterpret_cast< C* >( desc.m_member_owner );
+		const P1* p1 = GPCaseValues< P1 >( in[0] );
+		const P2* p2 = GPCaseValues< P2 >( in[1] );
+		static_cast< GPCaseColumnT< R >& >( out ).Fill( [&]( int c ) -> R { return (classptr->*function_ptr)( p1[c], p2[c] ); } );
+	}
+};
+
+template< class R, class P1, class P2, class P3 >
+struct GPCaseInvokeFunction3
+{
+	static void Invoke( const GPFunctionDesc& desc, GPCaseColumn& out, const GPCaseColumn* const* in )
+	{
+		typedef R(*WrappedFunctionSignature)(P1,P2,P3);
+		WrappedFunctionSignature function_ptr;
+		memcpy( &function_ptr, desc.m_function_ptr, sizeof( WrappedFunctionSignature ) );
+		const P1* p1 = GPCaseValues< P1 >( in[0] );
+		const P2* p2 = GPCaseValues< P2 >( in[1] );
+		const P3* p3 = GPCaseValues< P3 >( in[2] );
+		static_cast< GPCaseColumnT< R >& >( out ).Fill( [&]( int c ) -> R { return function_ptr( p1[c], p2[c], p3[c] ); } );
+	}
+};
+
+template< class C, class R, class P1, class P2, class P3 >
+struct GPCaseInvokeMemberFunction3
+{
+	static void Invoke( const GPFunctionDesc& desc, GPCaseColumn& out, const GPCaseColumn* const* in )
+	{
+		typedef R(C::*WrappedFunctionSignature)(P1,P2,P3);
+		WrappedFunctionSignature function_ptr;
+		memcpy( &function_ptr, desc.m_function_ptr, sizeof( WrappedFunctionSignature ) );
+		C* classptr = reinterpret_cast< C* >( desc.m_member_owner );
+		const P1* p1 = GPCaseValues< P1 >( in[0] );
+		const P2* p2 = GPCaseValues< P2 >( in[1] );
+		const P3* p3 = GPCaseValues< P3 >( in[2] );
+		static_cast< GPCaseColumnT< R >& >( out ).Fill( [&]( int c ) -> R { return (classptr->*function_ptr)( p1[c], p2[c], p3[c] ); } );
+	}
+};
+
 template< class R >
 R ExecuteTree( const GPFunctionLookup& functions, const GPTreeNode* treeRoot )
 {
@@ -369,6 +722,9 @@ R ExecuteTree( const GPFunctionLookup& functions, const GPTreeNode* treeRoot )
 template< class R >
 GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)() )
 {
+	assert( !m_locked );
+	if ( m_locked ) return GPFunctionLookup::NULLFUNC;
+
 	typedef R (*InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef GPDelayedEvaluation< R > (*DelayedInvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R (*ActualSignature)();
@@ -389,6 +745,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)() )
 	finfo.m_return_type	= return_type;
 	finfo.m_nparams		= 0;
 
+	finfo.m_case_column_ptr	= GPCaseColumnPtr< R >::Get();
+
 	strncpy( finfo.m_debug_name, name, GP_DEBUGNAME_LEN );
 
 	// fill out a copy for the delayed version of this function
@@ -396,6 +754,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)() )
 
 	delayedfinfo.m_return_type	= GPGetTypeID< GPDelayedEvaluation< R > >();
 	delayedfinfo.m_invoke_ptr	= reinterpret_cast< uintptr_t >( delayed_invoke_func );
+	delayedfinfo.m_case_invoke_ptr	= 0;
+	delayedfinfo.m_case_column_ptr	= 0;
 
 	// we will be storing the original version of the delayed function after
 	// the delayed function
@@ -411,6 +771,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)() )
 template< class C, class R >
 GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R (C::*myFunc)() )
 {
+	assert( !m_locked );
+	if ( m_locked ) return GPFunctionLookup::NULLFUNC;
+
 	typedef R (*InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef GPDelayedEvaluation< R > (*DelayedInvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R (C::*ActualSignature)();
@@ -432,6 +795,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 	finfo.m_nparams		= 0;
 	finfo.m_member_owner = reinterpret_cast< uintptr_t >( owner );
 
+	finfo.m_case_column_ptr	= GPCaseColumnPtr< R >::Get();
+
 	strncpy( finfo.m_debug_name, name, GP_DEBUGNAME_LEN );
 
 	// fill out a copy for the delayed version of this function
@@ -439,6 +804,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 
 	delayedfinfo.m_return_type	= GPGetTypeID< GPDelayedEvaluation< R > >();
 	delayedfinfo.m_invoke_ptr	= reinterpret_cast< uintptr_t >( delayed_invoke_func );
+	delayedfinfo.m_case_invoke_ptr	= 0;
+	delayedfinfo.m_case_column_ptr	= 0;
 
 	// we will be storing the original version of the delayed function after
 	// the delayed function
@@ -453,6 +820,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 template< class R, class P1 >
 GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1 ) )
 {
+	assert( !m_locked );
+	if ( m_locked ) return GPFunctionLookup::NULLFUNC;
+
 	typedef R (*InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef GPDelayedEvaluation< R > (*DelayedInvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R (*ActualSignature)( P1 );
@@ -474,6 +844,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1 )
 	finfo.m_param_types[0]	= p1Type;
 	finfo.m_nparams			= 1;
 
+	finfo.m_case_invoke_ptr	= GPCaseInvokePtr< GPCaseCacheable< R >::value && GPCaseCacheable< P1 >::value, GPCaseInvokeFunction1< R, P1 > >::Get();
+	finfo.m_case_column_ptr	= GPCaseColumnPtr< R >::Get();
+
 	strncpy( finfo.m_debug_name, name, GP_DEBUGNAME_LEN );
 
 	// fill out a copy for the delayed version of this function
@@ -481,6 +854,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1 )
 
 	delayedfinfo.m_return_type	= GPGetTypeID< GPDelayedEvaluation< R > >();
 	delayedfinfo.m_invoke_ptr	= reinterpret_cast< uintptr_t >( delayed_invoke_func );
+	delayedfinfo.m_case_invoke_ptr	= 0;
+	delayedfinfo.m_case_column_ptr	= 0;
 
 	// we will be storing the original version of the delayed function after
 	// the delayed function
@@ -495,6 +870,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1 )
 template< class C, class R, class P1 >
 GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R (C::*myFunc)( P1 ) )
 {
+	assert( !m_locked );
+	if ( m_locked ) return GPFunctionLookup::NULLFUNC;
+
 	typedef R (*InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef GPDelayedEvaluation< R > (*DelayedInvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R (C::*ActualSignature)( P1 );
@@ -518,6 +896,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 	finfo.m_nparams			= 1;
 	finfo.m_member_owner	= reinterpret_cast< uintptr_t >( owner );
 
+	finfo.m_case_invoke_ptr	= GPCaseInvokePtr< GPCaseCacheable< R >::value && GPCaseCacheable< P1 >::value, GPCaseInvokeMemberFunction1< C, R, P1 > >::Get();
+	finfo.m_case_column_ptr	= GPCaseColumnPtr< R >::Get();
+
 	strncpy( finfo.m_debug_name, name, GP_DEBUGNAME_LEN );
 
 	// fill out a copy for the delayed version of this function
@@ -525,6 +906,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 
 	delayedfinfo.m_return_type	= GPGetTypeID< GPDelayedEvaluation< R > >();
 	delayedfinfo.m_invoke_ptr	= reinterpret_cast< uintptr_t >( delayed_invoke_func );
+	delayedfinfo.m_case_invoke_ptr	= 0;
+	delayedfinfo.m_case_column_ptr	= 0;
 
 	// we will be storing the original version of the delayed function after
 	// the delayed function
@@ -539,6 +922,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 template< class R, class P1, class P2 >
 GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1, P2 ) )
 {
+	assert( !m_locked );
+	if ( m_locked ) return GPFunctionLookup::NULLFUNC;
+
 	typedef R (*InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef GPDelayedEvaluation< R > (*DelayedInvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R (*ActualSignature)( P1, P2 );
@@ -563,6 +949,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1,
 	finfo.m_param_types[1]	= p2Type;
 	finfo.m_nparams			= 2;
 
+	finfo.m_case_invoke_ptr	= GPCaseInvokePtr< GPCaseCacheable< R >::value && GPCaseCacheable< P1 >::value && GPCaseCacheable< P2 >::value, GPCaseInvokeFunction2< R, P1, P2 > >::Get();
+	finfo.m_case_column_ptr	= GPCaseColumnPtr< R >::Get();
+
 	strncpy( finfo.m_debug_name, name, GP_DEBUGNAME_LEN );
 
 	// fill out a copy for the delayed version of this function
@@ -570,6 +959,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1,
 
 	delayedfinfo.m_return_type		= GPGetTypeID< GPDelayedEvaluation< R > >();
 	delayedfinfo.m_invoke_ptr	= reinterpret_cast< uintptr_t >( delayed_invoke_func );
+	delayedfinfo.m_case_invoke_ptr	= 0;
+	delayedfinfo.m_case_column_ptr	= 0;
 
 	// we will be storing the original version of the delayed function after
 	// the delayed function
@@ -584,6 +975,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1,
 template< class C, class R, class P1, class P2 >
 GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R (C::*myFunc)( P1, P2 ) )
 {
+	assert( !m_locked );
+	if ( m_locked ) return GPFunctionLookup::NULLFUNC;
+
 	typedef R (*InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef GPDelayedEvaluation< R > (*DelayedInvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R (C::*ActualSignature)( P1, P2 );
@@ -609,6 +1003,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 	finfo.m_nparams			= 2;
 	finfo.m_member_owner	= reinterpret_cast< uintptr_t >( owner );
 
+	finfo.m_case_invoke_ptr	= GPCaseInvokePtr< GPCaseCacheable< R >::value && GPCaseCacheable< P1 >::value && GPCaseCacheable< P2 >::value, GPCaseInvokeMemberFunction2< C, R, P1, P2 > >::Get();
+	finfo.m_case_column_ptr	= GPCaseColumnPtr< R >::Get();
+
 	strncpy( finfo.m_debug_name, name, GP_DEBUGNAME_LEN );
 
 	// fill out a copy for the delayed version of this function
@@ -616,6 +1013,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 
 	delayedfinfo.m_return_type	= GPGetTypeID< GPDelayedEvaluation< R > >();
 	delayedfinfo.m_invoke_ptr	= reinterpret_cast< uintptr_t >( delayed_invoke_func );
+	delayedfinfo.m_case_invoke_ptr	= 0;
+	delayedfinfo.m_case_column_ptr	= 0;
 
 	// we will be storing the original version of the delayed function after
 	// the delayed function
@@ -630,6 +1029,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 template< class R, class P1, class P2, class P3 >
 GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1, P2, P3 ) )
 {
+	assert( !m_locked );
+	if ( m_locked ) return GPFunctionLookup::NULLFUNC;
+
 	typedef R (*InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef GPDelayedEvaluation< R > (*DelayedInvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R (*ActualSignature)( P1, P2, P3 );
@@ -656,6 +1058,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1,
 	finfo.m_param_types[2]	= p3Type;
 	finfo.m_nparams			= 3;
 
+	finfo.m_case_invoke_ptr	= GPCaseInvokePtr< GPCaseCacheable< R >::value && GPCaseCacheable< P1 >::value && GPCaseCacheable< P2 >::value && GPCaseCacheable< P3 >::value, GPCaseInvokeFunction3< R, P1, P2, P3 > >::Get();
+	finfo.m_case_column_ptr	= GPCaseColumnPtr< R >::Get();
+
 	strncpy( finfo.m_debug_name, name, GP_DEBUGNAME_LEN );
 
 	// fill out a copy for the delayed version of this function
@@ -663,6 +1068,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1,
 
 	delayedfinfo.m_return_type	= GPGetTypeID< GPDelayedEvaluation< R > >();
 	delayedfinfo.m_invoke_ptr	= reinterpret_cast< uintptr_t >( delayed_invoke_func );
+	delayedfinfo.m_case_invoke_ptr	= 0;
+	delayedfinfo.m_case_column_ptr	= 0;
 
 	// we will be storing the original version of the delayed function after
 	// the delayed function
@@ -677,6 +1084,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, R (*myFunc)( P1,
 template< class C, class R, class P1, class P2, class P3 >
 GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R (C::*myFunc)( P1, P2, P3 ) )
 {
+	assert( !m_locked );
+	if ( m_locked ) return GPFunctionLookup::NULLFUNC;
+
 	typedef R (*InvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef GPDelayedEvaluation< R > (*DelayedInvokeSignature)(const GPFunctionLookup& , const GPTreeNode&);
 	typedef R (C::*ActualSignature)( P1, P2, P3 );
@@ -704,6 +1114,9 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 	finfo.m_nparams			= 3;
 	finfo.m_member_owner	= reinterpret_cast< uintptr_t >( owner );
 
+	finfo.m_case_invoke_ptr	= GPCaseInvokePtr< GPCaseCacheable< R >::value && GPCaseCacheable< P1 >::value && GPCaseCacheable< P2 >::value && GPCaseCacheable< P3 >::value, GPCaseInvokeMemberFunction3< C, R, P1, P2, P3 > >::Get();
+	finfo.m_case_column_ptr	= GPCaseColumnPtr< R >::Get();
+
 	strncpy( finfo.m_debug_name, name, GP_DEBUGNAME_LEN );
 
 	// fill out a copy for the delayed version of this function
@@ -711,6 +1124,8 @@ GPFuncID GPFunctionLookup::RegisterFunction( const char* name, const C* owner, R
 
 	delayedfinfo.m_return_type	= GPGetTypeID< GPDelayedEvaluation< R > >();
 	delayedfinfo.m_invoke_ptr	= reinterpret_cast< uintptr_t >( delayed_invoke_func );
+	delayedfinfo.m_case_invoke_ptr	= 0;
+	delayedfinfo.m_case_column_ptr	= 0;
 
 	// we will be storing the original version of the delayed function after
 	// the delayed function
@@ -0,0 +1,117 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPISLANDS_H
+#define GPISLANDS_H
+
+#include <atomic>
+#include <vector>
+#include "gpdefines.h"
+#include "gptree.h"
+
+class GPEnvironment;
+
+enum GPMigrationTopology
+{
+	GPMIGRATE_RING,		// each island sends to the next, the last to the first
+	GPMIGRATE_RANDOM	// each migrant goes to a randomly chosen other island
+};
+
+// ---------------------------------------------------------------------------
+// GPIslands
+//
+// Evolves several GPEnvironments (islands) at once, each on its own thread,
+// with every island running the whole evaluate / breed loop independently.
+// Every few generations copies of each island's best individuals migrate to
+// other islands, where they replace the worst.
+//
+// Migrants are posted to the receiving island's inbox, a lock-free list which
+// any number of threads can push onto and the owner takes in one go. Islands
+// never wait on each other: migrants are picked up at the receiver's next
+// migration, whenever that is.
+//
+// The islands are set up by the caller exactly as they would be to run alone
+// (functions, fitness function, population), and are not owned. Each should
+// be generated before Run().
+//
+// Limitations:
+//	* The islands must have the same functions registered in the same order
+//	  (or ShareFunctions() the one lookup), since migrants are copied as is.
+//	* Fitness functions, and the functions they execute, are called on several
+//	  threads at once, so must not share state between islands.
+//	* Each island's thread seeds its random generator (see GPRand) from rand()
+//	  in whatever order the threads start, so runs are not repeatable from a seed.
+//
+class GPIslands
+{
+public:
+	GPIslands();
+	~GPIslands();
+
+	void			AddIsland( GPEnvironment& island );
+	int				GetNumIslands() const;
+	GPEnvironment&	GetIsland( int index ) const;
+
+	// every interval generations each island sends copies of its num_migrants best
+	// individuals. 0 for either turns migration off.
+	void			SetMigration( int interval, int num_migrants, GPMigrationTopology topology );
+
+	// runs generations of EvaluateAll() and MutateAndCrossover() on every island,
+	// and returns once all have finished. every island is left evaluated.
+	void			Run( int generations );
+
+	// the island holding the fittest individual, after Run()
+	int				GetFittestIsland() const;
+
+private:
+	GPIslands( const GPIslands& );
+	GPIslands& operator=( const GPIslands& );
+
+	struct Migrant
+	{
+		GPTree*		m_tree;
+		Migrant*	m_next;
+	};
+
+	struct Island
+	{
+		GPEnvironment*				m_environment;
+		std::atomic< Migrant* >		m_inbox;
+	};
+
+	void	RunIsland( int index, int generations );
+	void	Emigrate( int index );
+	void	Immigrate( int index );
+	void	Post( int destination, GPTree* tree );
+	void	ClearInboxes();
+
+	// Islands hold an atomic, so can't be moved once created
+	std::vector< Island* >	m_islands;
+
+	int						m_interval;
+	int						m_num_migrants;
+	GPMigrationTopology		m_topology;
+};
+
+#endif
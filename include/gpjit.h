@@ -0,0 +1,116 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPJIT_H
+#define GPJIT_H
+
+#include "gpfunctionlookup.h"
+
+// ---------------------------------------------------------------------------
+// GPJitOperation
+//
+// What a registered function does, as far as the JIT is concerned. Only
+// functions of the exact form described may be given an operation.
+//
+enum GPJitOperation
+{
+	GPJIT_NONE,				// not compilable, trees using it fall back to ExecuteTree
+	GPJIT_ADD,				// double f( double a, double b ) { return a + b; }
+	GPJIT_SUB,				// double f( double a, double b ) { return a - b; }
+	GPJIT_MUL,				// double f( double a, double b ) { return a * b; }
+	GPJIT_PROTECTED_DIV,	// double f( double a, double b ) { return b == 0 ? 1 : a / b; }
+	GPJIT_CONSTANT,			// double f() always returning the same value, read once at compile time
+	GPJIT_TERMINAL				// double f(), called from the compiled code (ie: reads an input)
+};
+
+// ---------------------------------------------------------------------------
+// GPJitOperations
+//
+// The whitelist of functions the JIT may compile, for one GPFunctionLookup.
+//
+class GPJitOperations
+{
+public:
+	GPJitOperations( const GPFunctionLookup& functions );
+
+	// returns false (and asserts) if the function does not have the signature
+	// the operation requires, or is a member function.
+	bool			Allow( GPFuncID function, GPJitOperation operation );
+	bool			Allow( const char* name, GPJitOperation operation );
+
+	GPJitOperation	GetOperation( GPFuncID function ) const;
+	const GPFunctionLookup& GetFunctions() const	{ return m_functions; }
+
+private:
+	GPJitOperations& operator=( const GPJitOperations& );
+
+	const GPFunctionLookup& m_functions;
+	GPJitOperation			m_operations[ GP_MAX_FUNCTIONS * 2 ];
+};
+
+// ---------------------------------------------------------------------------
+// GPJitTree
+//
+// Compiles a tree returning double straight into x86-64 machine code, for
+// trees built purely from whitelisted arithmetic. Fitness functions which run
+// the same individual over many rows of data compile it once per evaluation
+// and then call Execute() per row.
+//
+// Any tree using a function outside the whitelist (or any platform other than
+// x86-64) is not compiled, and Execute() falls back to ExecuteTree on a copy
+// of the tree, so callers need not care which path is taken.
+//
+// Limitations:
+//	* double only, no delayed evaluation (conditionals are not compilable).
+//	* compiled code does not count against GPExecutionBudget. without loops
+//	  or conditionals its running time is fixed by the tree size anyway.
+//
+class GPJitTree
+{
+public:
+	GPJitTree();
+	~GPJitTree();
+
+	// returns true if machine code was generated, false if the fallback will be used
+	bool	Compile( const GPJitOperations& operations, const GPTree* tree );
+	bool	IsCompiled() const;
+	void	Release();
+
+	double	Execute() const;
+
+private:
+	// the code and fallback tree are owned, so no copying
+	GPJitTree( const GPJitTree& );
+	GPJitTree& operator=( const GPJitTree& );
+
+	typedef double(*CompiledSignature)();
+
+	void*					m_code;
+	size_t					m_code_size;
+
+	const GPFunctionLookup*	m_functions;
+	GPTree*					m_fallback;
+};
+
+#endif
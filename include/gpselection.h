@@ -0,0 +1,51 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPSELECTION_H
+#define GPSELECTION_H
+
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// GPRankNonDominated
+//
+// Orders points with several objectives the way NSGA-II selects: by Pareto
+// front first (the points nothing dominates, then those only the first front
+// dominates, and so on), then within each front by crowding distance, so the
+// points at the ends and in the sparse parts of a front come first. Points
+// tied on both keep their order from sorting on the objectives, first to last.
+//
+// The fronts are found with an efficient non-dominated sort (ENS-BS): points
+// are taken in lexicographic order, so none can be dominated by a later one,
+// and each is put in the first front with nothing dominating it, found by a
+// binary search over the fronts. That only compares a point against a few
+// fronts, rather than against every other point as the original fast
+// non-dominated sort does, so it scales to large populations.
+//
+// objectives holds num_objectives values for each point, point after point,
+// all to be minimised. ranked is filled with the point indices, best first.
+//
+void GPRankNonDominated( const std::vector< double >& objectives, int num_objectives, std::vector< int >& ranked );
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPSTATICFUNCTIONSET_H
+#define GPSTATICFUNCTIONSET_H
+
+#include "gpfunctionlookup.h"
+
+// every function registers a delayed version first, and then the original.
+// so a static set's function index maps directly onto the registered ids.
+inline GPFuncID GPStaticFunctionSetID( int index )
+{
+	return index * 2 + 1;
+}
+
+inline int GPStaticFunctionSetIndex( GPFuncID id )
+{
+	return id / 2;
+}
+
+template< class A, class B >
+struct GPStaticSameType
+{
+	static const bool value = false;
+};
+
+template< class A >
+struct GPStaticSameType< A, A >
+{
+	static const bool value = true;
+};
+
+// ---------------------------------------------------------------------------
+// GPStaticFunction
+//
+// Wraps a free function which is known at compile time, so it can be called
+// directly rather than through the m_invoke_ptr/m_function_ptr pair stored
+// in its GPFunctionDesc. Use GPSTATIC_FUNCTION to declare one:
+//
+//		GPSTATIC_FUNCTION( AddNode, Add )
+//
+// declares the type AddNode, which calls Add() and registers as "Add".
+//
+// Limitations:
+//		Member functions are not supported since their owner is only known
+//		at runtime. Register those through the dynamic API instead.
+//
+template< class Signature, Signature Func >
+struct GPStaticFunction;
+
+#define GPSTATIC_FUNCTION( name, func ) \
+struct name : public GPStaticFunction< decltype( &func ), &func > \
+{ \
+	static const char* Name() { return #func; } \
+};
+
+// ---------------------------------------------------------------------------
+// GPStaticParameter
+//
+// Calculates a parameter for a statically dispatched function. Parameters
+// which are GPDelayedEvaluation<>'s are handed the static Invoke so the
+// delayed branch still avoids the dynamic dispatch.
+//
+template< class Set, class P >
+struct GPStaticParameter
+{
+	static P Evaluate( const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		return Set::template Invoke< P >( functions, f );
+	}
+};
+
+template< class Set, class R >
+struct GPStaticParameter< Set, GPDelayedEvaluation< R > >
+{
+	static GPDelayedEvaluation< R > Evaluate( const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		return GPDelayedEvaluation< R >( functions, f, &Set::template Invoke< R > );
+	}
+};
+
+template< class R, R (*Func)() >
+struct GPStaticFunction< R (*)(), Func >
+{
+	typedef R ReturnType;
+
+	static R (*Pointer())() { return Func; }
+
+	template< class Set >
+	static R Call( const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		return Func();
+	}
+};
+
+template< class R, class P1, R (*Func)( P1 ) >
+struct GPStaticFunction< R (*)( P1 ), Func >
+{
+	typedef R ReturnType;
+
+	static R (*Pointer())( P1 ) { return Func; }
+
+	template< class Set >
+	static R Call( const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		return Func
+			(
+				GPStaticParameter< Set, P1 >::Evaluate( functions, *(f.parameters[0]) )
+			);
+	}
+};
+
+template< class R, class P1, class P2, R (*Func)( P1, P2 ) >
+struct GPStaticFunction< R (*)( P1, P2 ), Func >
+{
+	typedef R ReturnType;
+
+	static R (*Pointer())( P1, P2 ) { return Func; }
+
+	template< class Set >
+	static R Call( const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		return Func
+			(
+				GPStaticParameter< Set, P1 >::Evaluate( functions, *(f.parameters[0]) ),
+				GPStaticParameter< Set, P2 >::Evaluate( functions, *(f.parameters[1]) )
+			);
+	}
+};
+
+template< class R, class P1, class P2, class P3, R (*Func)( P1, P2, P3 ) >
+struct GPStaticFunction< R (*)( P1, P2, P3 ), Func >
+{
+	typedef R ReturnType;
+
+	static R (*Pointer())( P1, P2, P3 ) { return Func; }
+
+	template< class Set >
+	static R Call( const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		return Func
+			(
+				GPStaticParameter< Set, P1 >::Evaluate( functions, *(f.parameters[0]) ),
+				GPStaticParameter< Set, P2 >::Evaluate( functions, *(f.parameters[1]) ),
+				GPStaticParameter< Set, P3 >::Evaluate( functions, *(f.parameters[2]) )
+			);
+	}
+};
+
+// ---------------------------------------------------------------------------
+// GPStaticCase
+//
+// One 'case' of the dispatch. Functions which return some other type than
+// the one being asked for can never be the node in question, so they drop
+// out of the comparison chain entirely.
+//
+template< class Set, int Index, class F, class R, class Next, bool Matches >
+struct GPStaticCase
+{
+	static R Invoke( int index, const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		return Next::template Invoke< R >( index, functions, f );
+	}
+};
+
+template< class Set, int Index, class F, class R, class Next >
+struct GPStaticCase< Set, Index, F, R, Next, true >
+{
+	static R Invoke( int index, const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		if ( index == Index )
+		{
+			return F::template Call< Set >( functions, f );
+		}
+
+		return Next::template Invoke< R >( index, functions, f );
+	}
+};
+
+// ---------------------------------------------------------------------------
+// GPStaticDispatch
+//
+// Unrolls the function list of a GPStaticFunctionSet at compile time. For
+// any one return type the result is a chain of compares against constants,
+// which the compiler can lower into a switch/jump table and inline through.
+//
+template< class Set, int Index, class... Functions >
+struct GPStaticDispatch
+{
+	static void Register( GPFunctionLookup& functions )
+	{
+	}
+
+	template< class R >
+	static R Invoke( int index, const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		// if this assert fires the tree holds a node which was not registered
+		// through this function set, or which has an unexpected return type.
+		assert( false );
+		return R();
+	}
+
+	static uintptr_t GetInvokePtr( GPTypeID return_type )
+	{
+		return 0;
+	}
+};
+
+template< class Set, int Index, class F, class... Rest >
+struct GPStaticDispatch< Set, Index, F, Rest... >
+{
+	typedef GPStaticDispatch< Set, Index + 1, Rest... > Next;
+	typedef typename F::ReturnType FR;
+
+	static void Register( GPFunctionLookup& functions )
+	{
+		GPFuncID id = functions.RegisterFunction( F::Name(), F::Pointer() );
+
+		// the static index is derived from the function id, so the set must be
+		// the first (and only) thing registered with this lookup.
+		assert( id == GPStaticFunctionSetID( Index ) );
+
+		Next::Register( functions );
+	}
+
+	template< class R >
+	static R Invoke( int index, const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		return GPStaticCase< Set, Index, F, R, Next, GPStaticSameType< FR, R >::value >::Invoke( index, functions, f );
+	}
+
+	static uintptr_t GetInvokePtr( GPTypeID return_type )
+	{
+		typedef FR (*InvokeFuncSignature)( const GPFunctionLookup& functions, const GPTreeNode& f );
+
+		if ( GPGetTypeID< FR >() == return_type )
+		{
+			InvokeFuncSignature invoke_func = &Set::template Invoke< FR >;
+			return reinterpret_cast< uintptr_t >( invoke_func );
+		}
+
+		return Next::GetInvokePtr( return_type );
+	}
+};
+
+// ---------------------------------------------------------------------------
+// GPStaticFunctionSet
+//
+// A compile time alternative to filling out a GPFunctionLookup one
+// RegisterFunction() call at a time. All the primitives are listed in the
+// type itself:
+//
+//		GPSTATIC_FUNCTION( AddNode, Add )
+//		GPSTATIC_FUNCTION( TwoNode, Two )
+//		typedef GPStaticFunctionSet< AddNode, TwoNode > MyFunctions;
+//
+// Register() still fills out the dynamic lookup, so trees are generated,
+// bred and serialized exactly as before. Only execution changes: Execute()
+// switches on the node's function id and calls the primitive directly,
+// rather than going through m_invoke_ptr and copying out m_function_ptr.
+//
+// GPEnvironment::UseStaticFunctionSet<>() does all of this for an
+// environment's individuals.
+//
+template< class... Functions >
+class GPStaticFunctionSet
+{
+	typedef GPStaticFunctionSet< Functions... >				ThisSet;
+	typedef GPStaticDispatch< ThisSet, 0, Functions... >	Dispatch;
+
+public:
+	// registers every function in the set. must be done on an empty lookup.
+	static void Register( GPFunctionLookup& functions )
+	{
+		Dispatch::Register( functions );
+	}
+
+	// same signature as the invoke functions stored in the dynamic lookup
+	template< class R >
+	static R Invoke( const GPFunctionLookup& functions, const GPTreeNode& f )
+	{
+		GPExecutionBudget::Step();
+		return Dispatch::template Invoke< R >( GPStaticFunctionSetIndex( f.functionID ), functions, f );
+	}
+
+	// statically dispatched equivalent of ExecuteTree<>
+	template< class R >
+	static R Execute( const GPFunctionLookup& functions, const GPTreeNode* treeRoot )
+	{
+		return Invoke< R >( functions, *treeRoot );
+	}
+
+	// returns the Invoke<> for the given return type as a uintptr_t (the same
+	// way m_invoke_ptr is stored), or 0 if no function returns that type.
+	static uintptr_t GetInvokePtr( GPTypeID return_type )
+	{
+		return Dispatch::GetInvokePtr( return_type );
+	}
+};
+
+#endif
@@ -84,7 +84,7 @@ public:
 	template< class T >
 	void PushListValue( const char* name, const T& val );
 
-	void IncrementCounter( const char* name );
+	void IncrementCounter( const char* name, int amount = 1 );
 
 	//
 	// TODO: gets are slow at the moment because they only work on name
@@ -92,6 +92,10 @@ public:
 	template< class T >
 	bool GetListValues( const char* name, const typename GPStatsValueList< T >::ValueList*& outList ) const;
 
+	// counters (see IncrementCounter) are single values of type int
+	template< class T >
+	bool GetSingleValue( const char* name, T& outValue ) const;
+
 private:
 	GPStatsMap m_stats;
 
@@ -162,5 +166,20 @@ bool GPStats::GetListValues( const char* name, const typename GPStats::GPStatsVa
 	return false;
 }
 
+template< class T >
+bool GPStats::GetSingleValue( const char* name, T& outValue ) const
+{
+	GPHash id = GPHashString( name, strlen( name ) );
+
+	// TODO: assert type check that we're getting the right type for this name
+	GPStatsMap::const_iterator iter = m_stats.find( id );
+	if ( iter == m_stats.end() )
+	{
+		return false;
+	}
+
+	outValue = reinterpret_cast< const GPStatsValue< T > * >( iter->second )->m_value;
+	return true;
+}
 
 #endif // GPSTATS_H
\ No newline at end of file
@@ -34,6 +34,12 @@
 struct GPTreeNode
 {
 	// TODO: the parameters are fixed to 3. be nice to tie this in to GP_MAX_PARAMETERS
+	// nodes come from a free list per thread (see gptree.cpp), since trees are built
+	// and thrown away constantly while breeding. anything of another size (a derived
+	// class) goes to the global allocator.
+	static void*	operator new( size_t size );
+	static void		operator delete( void* node, size_t size );
+
 	GPTreeNode( GPFuncID function, GPTreeNode* p1 = NULL, GPTreeNode* p2 = NULL, GPTreeNode* p3 = NULL )
 	{
 		functionID = function;
@@ -98,6 +104,16 @@ public:
 	int					MaxNodes()	const;
 	GPTree*				Duplicate() const;
 
+	// hash of the tree's structure (its preorder function IDs), equal for identical trees
+	GPHash				Hash() const;
+
+	// makes this tree a copy of other, reusing this tree's nodes where the shapes
+	// match, so a tree can be recycled rather than freed and duplicated
+	void				CopyFrom( const GPTree* other );
+
+	// empties the tree, ready to be refilled with Replace( NULL, ... )
+	void				Clear( int max_nodes );
+
 	//
 	// given a node already in this tree, it will be replaced by given node for subtree
 	// NO RETURN TYPE CHECKS ARE DONE! Just a subtree swap
@@ -107,6 +123,24 @@ public:
 	//
 	GPTreeNode*			Replace( const GPTreeNode* source_node, GPTreeNode* new_subtree );
 
+	//
+	// changes the function of a node in this tree, leaving its children. NO SIGNATURE
+	// CHECKS ARE DONE! the new function should take the same parameters.
+	//
+	void				SetFunction( const GPTreeNode* node, GPFuncID function );
+
+	//
+	// makes a node in this tree the new root, deleting everything outside its subtree.
+	// NO RETURN TYPE CHECKS ARE DONE!
+	//
+	void				Hoist( const GPTreeNode* node );
+
+	//
+	// turns a node in this tree into a leaf, deleting its children and reusing the node
+	// for terminal. NO RETURN TYPE CHECKS ARE DONE! terminal should take no parameters.
+	//
+	void				Collapse( const GPTreeNode* node, GPFuncID terminal );
+
 
 	// ---------------------------------------------------------------------------
 	// Below are operations that are not specific to a particular tree
@@ -137,6 +171,14 @@ private:
 	static ConstFlattenedTreePtr	FlattenSubtree( const GPTreeNode* node );
 	static FlattenedTreePtr			FlattenSubtree( GPTreeNode* node );
 
+	static void						HashSubtree( const GPTreeNode* node, GPHash& hash );
+
+	// true if node is part of this tree
+	bool							Contains( const GPTreeNode* node ) const;
+
+	// overwrites existing (which may be NULL) with a copy of source, and returns it
+	static GPTreeNode*				CopySubtree( GPTreeNode* existing, const GPTreeNode* source );
+
 	int	m_max_nodes;
 	int m_count;
 
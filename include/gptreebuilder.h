@@ -0,0 +1,114 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPTREEBUILDER_H
+#define GPTREEBUILDER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "gpdefines.h"
+#include "gpfunctionlookup.h"
+
+enum GPBuildMethod
+{
+	GP_BUILD_GROW,	// any function at any depth up to the max, so shapes and sizes vary
+	GP_BUILD_FULL	// only functions taking parameters until the max depth, so every branch reaches it
+};
+
+// ---------------------------------------------------------------------------
+// GPTreeBuilder
+//
+// Builds random trees to a given depth, for initialising a population. The
+// functions are sorted by return type into terminals (no parameters) and
+// non-terminals once up front, along with the smallest subtree (in nodes and
+// in depth) each function and type can make. So building never has to scan
+// for a function which fits, and can't paint itself into a corner.
+//
+// Trees are bounded by max_nodes as well as the depth. When the nodes run
+// short a branch ends sooner than the method asks, rather than the tree
+// growing past its max. The depth of a lone terminal is 0.
+//
+// Limitations:
+//	* The lookup must not change while a builder made from it is in use.
+//	* Build() only reads the builder, so any number of threads can use one
+//	  at once, but each needs its own GPRand seed for repeatable results.
+//
+class GPTreeBuilder
+{
+public:
+	GPTreeBuilder( const GPFunctionLookup& functions );
+
+	// true if a tree returning return_type can be built in max_nodes. if not,
+	// GetError() says which functions are the problem.
+	bool			CanBuild( GPTypeID return_type, int max_nodes );
+	const char*		GetError() const	{ return m_error.c_str(); }
+
+	// builds a random subtree returning return_type. CanBuild must be true for
+	// return_type and max_nodes. the number of nodes used is returned through nodes_used.
+	GPTreeNode*		Build( GPTypeID return_type, GPBuildMethod method, int max_depth, int max_nodes, int& nodes_used ) const;
+
+private:
+	GPTreeBuilder( const GPTreeBuilder& );
+	GPTreeBuilder& operator=( const GPTreeBuilder& );
+
+	struct TypeTable
+	{
+		TypeTable() : m_min_size( kUnbuildable ), m_min_depth( kUnbuildable ) {}
+
+		std::vector< GPFuncID >	m_terminals;
+		std::vector< GPFuncID >	m_nonterminals;
+		std::vector< GPFuncID >	m_all;
+
+		// smallest subtree of this type, kUnbuildable if there is none
+		int						m_min_size;
+		int						m_min_depth;
+	};
+
+	typedef std::map< GPTypeID, TypeTable > TypeTableMap;
+
+	static const int kUnbuildable;
+
+	const TypeTable*	FindTable( GPTypeID type ) const;
+
+	// works out the smallest subtree of every function and type, repeating until none shrink
+	void				CalculateMinimums();
+
+	GPTreeNode*			BuildNode( GPTypeID type, GPBuildMethod method, int depth_left, int max_nodes, int& nodes_used, bool root ) const;
+
+	// picks a random function from list whose smallest subtree fits in max_nodes and
+	// depth_left. NULLFUNC if there are none.
+	GPFuncID			PickFunction( const std::vector< GPFuncID >& list, int depth_left, int max_nodes ) const;
+
+	const GPFunctionLookup&	m_functions;
+	TypeTableMap			m_types;
+
+	// indexed by function ID
+	std::vector< int >		m_function_min_size;
+	std::vector< int >		m_function_min_depth;
+
+	std::string				m_error;
+};
+
+#endif
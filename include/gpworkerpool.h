@@ -0,0 +1,137 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GPWORKERPOOL_H
+#define GPWORKERPOOL_H
+
+#include <vector>
+#include "gpdefines.h"
+#include "gptree.h"
+#include "gpevaluator.h"
+
+class GPEnvironment;
+
+// ---------------------------------------------------------------------------
+// GPAllocateSharedMemory
+//
+// Memory which stays shared with worker processes forked after it is allocated,
+// for datasets too large to copy or which are updated between generations (any
+// other memory is only copy-on-write shared, so changes after forking are not
+// seen by the workers). Returns NULL where processes are not supported.
+//
+void*	GPAllocateSharedMemory( size_t bytes );
+void	GPFreeSharedMemory( void* memory, size_t bytes );
+
+// ---------------------------------------------------------------------------
+// GPWorkerPool
+//
+// Evaluates individuals in forked worker processes, for fitness functions
+// which can't run on several threads (ie: they drive a simulator with global
+// state). Each worker is a copy of the environment at the time it was forked,
+// so has the same functions and fitness function. Individuals are sent to it
+// as their preorder sequence of function IDs over a socket, and it sends back
+// the fitness.
+//
+// A worker which dies mid-evaluation is restarted, and the individual it was
+// evaluating is given the environment's budget penalty (see
+// SetExecutionBudget), since it would most likely crash the next worker too.
+// Results are collected in whatever order the workers finish.
+//
+// Used through GPEnvironment::SetEvaluationWorkers, which owns the pool.
+//
+// Limitations:
+//	* POSIX only, needs fork().
+//	* Anything the fitness function changes in its own process (ie: stats it
+//	  keeps) stays in the worker.
+//	* The fitness function may only look at the individual it is given, the
+//	  rest of the worker's population is as it was when forked.
+//	* Individuals' case caches (see SetCaseFitnessFunction) aren't kept between
+//	  requests, so each evaluation in a worker executes the whole tree.
+//	* Don't fork from an environment running on one of several threads (ie:
+//	  a GPIslands island), only the forking thread exists in the child.
+//
+class GPWorkerPool : public GPEvaluator
+{
+public:
+	GPWorkerPool();
+	~GPWorkerPool();
+
+	// forks num_workers copies of environment. returns false if processes are unsupported.
+	bool	Start( GPEnvironment& environment, int num_workers );
+	void	Stop();
+
+	int		GetNumWorkers() const		{ return static_cast< int >( m_workers.size() ); }
+	bool	HasIdleWorker() const;
+	int		GetNumOutstanding() const;
+	int		GetNumRestarts() const		{ return m_num_restarts; }
+
+	void	Submit( int index, const GPTree* tree, GPFitness cutoff );
+	Result	Collect();
+
+private:
+	GPWorkerPool( const GPWorkerPool& );
+	GPWorkerPool& operator=( const GPWorkerPool& );
+
+	// followed on the socket by m_num_nodes function IDs
+	struct Request
+	{
+		int			m_index;
+		GPFitness	m_cutoff;
+		int			m_num_nodes;
+		int			m_max_nodes;
+	};
+
+	struct Response
+	{
+		GPFitness	m_fitness;
+		bool		m_overrun;
+		double		m_seconds;
+	};
+
+	struct Worker
+	{
+		int			m_pid;
+		int			m_socket;
+		bool		m_busy;
+		Request		m_request;
+	};
+
+	bool	Fork( Worker& worker );
+	void	Kill( Worker& worker );
+	void	Restart( Worker& worker );
+	bool	Send( Worker& worker );
+	Result	CrashedResult( const Worker& worker ) const;
+
+	static void	WorkerMain( GPEnvironment& environment, int socket );
+
+	GPEnvironment*			m_environment;
+	std::vector< Worker >	m_workers;
+	std::vector< Result >	m_crashed;
+	int						m_num_restarts;
+
+	// reused between requests to save reallocating the sequence every time
+	std::vector< GPFuncID >	m_preorder;
+};
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gpdefines.h"
+#include "gptree.h"
+#include "gpfunctionlookup.h"
+#include "gpcasecache.h"
+
+GPCaseCache::GPCaseCache()
+{
+	m_pass				= 0;
+	m_num_cases			= 0;
+	m_num_recomputed	= 0;
+}
+
+GPCaseCache::~GPCaseCache()
+{
+	Clear();
+}
+
+void GPCaseCache::Clear()
+{
+	for( EntryMap::iterator iter = m_entries.begin(); iter != m_entries.end(); ++iter )
+	{
+		delete iter->second.m_column;
+	}
+	m_entries.clear();
+}
+
+const GPCaseColumn& GPCaseCache::Update( const GPFunctionLookup& functions, const GPTree* tree, const GPCaseSelector& selector, int num_cases )
+{
+	if ( num_cases != m_num_cases )
+	{
+		Clear();
+		m_num_cases = num_cases;
+	}
+
+	++m_pass;
+	m_num_recomputed = 0;
+
+	bool recomputed;
+	const GPCaseColumn* root = NULL;
+	try
+	{
+		root = UpdateNode( functions, tree->Root(), selector, recomputed );
+	}
+	catch( ... )
+	{
+		// a column may have been left part filled, and its entry looks valid
+		Clear();
+		throw;
+	}
+
+	// anything not visited is no longer in the tree. its address may be reused
+	// by a later node, so the entry can't be kept around.
+	EntryMap::iterator iter = m_entries.begin();
+	while( iter != m_entries.end() )
+	{
+		if ( iter->second.m_pass != m_pass )
+		{
+			delete iter->second.m_column;
+			m_entries.erase( iter++ );
+		}
+		else
+		{
+			++iter;
+		}
+	}
+
+	return *root;
+}
+
+const GPCaseColumn* GPCaseCache::UpdateNode( const GPFunctionLookup& functions, const GPTreeNode* node, const GPCaseSelector& selector, bool& recomputed )
+{
+	const GPFunctionDesc&	desc		= functions.GetFunctionByID( node->functionID );
+	CaseInvokeSignature		case_invoke	= reinterpret_cast< CaseInvokeSignature >( desc.m_case_invoke_ptr );
+
+	// if this assert fires, the node returns a type which can't be stored in a column (void?)
+	assert( desc.m_case_column_ptr );
+
+	const GPCaseColumn* inputs[ GP_MAX_PARAMETERS ] = { NULL };
+	bool inputs_changed = false;
+
+	if ( case_invoke )
+	{
+		for( int i = 0; i < desc.m_nparams; ++i )
+		{
+			bool child_recomputed;
+			inputs[ i ] = UpdateNode( functions, node->parameters[ i ], selector, child_recomputed );
+			inputs_changed = inputs_changed || child_recomputed;
+		}
+	}
+
+	EntryMap::iterator iter = m_entries.find( node );
+	if ( iter != m_entries.end() && iter->second.m_function != node->functionID )
+	{
+		// a different function may return a different type, so needs a new column
+		delete iter->second.m_column;
+		m_entries.erase( iter );
+		iter = m_entries.end();
+	}
+
+	bool valid = iter != m_entries.end() && !inputs_changed;
+	if ( iter == m_entries.end() )
+	{
+		CreateColumnSignature create_column = reinterpret_cast< CreateColumnSignature >( desc.m_case_column_ptr );
+
+		Entry entry;
+		entry.m_function	= node->functionID;
+		entry.m_column		= create_column( m_num_cases );
+		iter = m_entries.insert( EntryMap::value_type( node, entry ) ).first;
+	}
+
+	Entry& entry = iter->second;
+	entry.m_pass = m_pass;
+
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+	{
+		valid = valid && entry.m_parameters[ i ] == node->parameters[ i ];
+		entry.m_parameters[ i ] = node->parameters[ i ];
+	}
+
+	// nodes with children we did not visit can't tell if their subtree changed
+	valid = valid && ( case_invoke || desc.m_nparams == 0 );
+
+	if ( !valid )
+	{
+		if ( case_invoke )
+		{
+			case_invoke( desc, *entry.m_column, inputs );
+		}
+		else
+		{
+			entry.m_column->ExecuteCases( functions, *node, selector );
+		}
+		++m_num_recomputed;
+	}
+
+	recomputed = !valid;
+	return entry.m_column;
+}
+
+void GPCaseCache::CopyFrom( const GPCaseCache& other, const GPTree* other_tree, const GPTree* tree )
+{
+	assert( &other != this );
+
+	Clear();
+	m_num_cases = other.m_num_cases;
+
+	if ( other_tree->Root() && tree->Root() )
+	{
+		CopyNode( other, other_tree->Root(), tree->Root() );
+	}
+}
+
+void GPCaseCache::CopyNode( const GPCaseCache& other, const GPTreeNode* other_node, const GPTreeNode* node )
+{
+	// if this assert fires, tree is not a duplicate of other_tree
+	assert( other_node->functionID == node->functionID );
+
+	EntryMap::const_iterator other_iter = other.m_entries.find( other_node );
+	if ( other_iter != other.m_entries.end() )
+	{
+		const Entry& other_entry = other_iter->second;
+
+		// the column is only valid for the function and children the other node had when
+		// it was computed. if the other tree has changed since, leave the copy uncached.
+		bool unchanged = other_entry.m_function == other_node->functionID;
+		for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+		{
+			unchanged = unchanged && other_entry.m_parameters[ i ] == other_node->parameters[ i ];
+		}
+
+		if ( unchanged )
+		{
+			Entry entry;
+			entry.m_function	= other_entry.m_function;
+			entry.m_column		= other_entry.m_column->Clone();
+			entry.m_pass		= m_pass;
+
+			for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+			{
+				entry.m_parameters[ i ] = node->parameters[ i ];
+			}
+
+			m_entries.insert( EntryMap::value_type( node, entry ) );
+		}
+	}
+
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+	{
+		if ( other_node->parameters[ i ] )
+		{
+			CopyNode( other, other_node->parameters[ i ], node->parameters[ i ] );
+		}
+	}
+}
@@ -23,6 +23,20 @@
  */
 
 #include "gpenvironment.h"
+#include "gpevaluator.h"
+#include "gpselection.h"
+#include "gpworkerpool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_set>
 
 
 
@@ -125,13 +139,12 @@ GPTreeNode* CreateRandomTree(	const GPFunctionLookup& functions,
 // ---------------------------------------------------------------------------
 // MutateTree:
 //		Will select a non-root node of the given tree, and attempt to generate
-//		a replacement subtree of any size (fitting within its max nodes)
+//		a replacement subtree of any size (fitting within its max nodes, and
+//		max_subtree_nodes if that isn't 0)
 //
-// Limitations:
-//		Subtree replacement is constrained to the same size. Maybe allow it to
-//		use more nodes?
+//		Returns whether the tree was changed.
 //
-void MutateTree( const GPFunctionLookup& functions, GPTree* tree )
+bool MutateTree( const GPFunctionLookup& functions, GPTree* tree, int max_subtree_nodes = 0 )
 {
 	GPConstSubtreeIter flattened( tree );
 
@@ -143,6 +156,10 @@ void MutateTree( const GPFunctionLookup& functions, GPTree* tree )
 	GPTypeID subtreeReturnType = functions.GetFunctionByID( flattened.GetNode( mutateNode )->functionID ).m_return_type;
 	int subtreeNodes = 0;
 	int availableNodes = tree->MaxNodes() - tree->Count() + subtreeCount;
+	if ( max_subtree_nodes > 0 )
+	{
+		availableNodes = std::min( availableNodes, max_subtree_nodes );
+	}
 	GPTreeNode* new_subtree = CreateRandomTree(	functions, subtreeReturnType, subtreeNodes, availableNodes );
 
 	// if we were able to generate a subtree, then do the swap
@@ -150,619 +167,2704 @@ void MutateTree( const GPFunctionLookup& functions, GPTree* tree )
 	{
 		// try replace the subtree's - whichever subtree is returned is the spare one
 		// and needs to be cleaned up
-		GPTree::DeleteSubtree( tree->Replace( oldSubtree, new_subtree ) );
+		GPTreeNode* spare_subtree = tree->Replace( oldSubtree, new_subtree );
+		GPTree::DeleteSubtree( spare_subtree );
+
+		return spare_subtree == oldSubtree;
 	}
 
+	return false;
 }
 
-// ---------------------------------------------------------------------------
-// Prune:
-//		Iterates over given tree finding nodes which have a subtree coming
-//		off them that can be replaced with a single leaf node.
-//		Caller specifies the number of nodes to attempt to remove.
-//		Optionally a node can be specified which has to be preserved. This 
-//		node and its direct parents will be guaranteed to still exist in the
-//		pruned tree.
-//
-// Limitations:
-//		* The algorithm fails if the node selected to be pruned cannot be
-//		replaced with a single node (ie: there isnt a parameter-less function
-//		for that returntype)
-//		* The algorithm cannot reverse an operation, and does not calculate
-//		whether the Prune can reach the desired target. So in the event
-//		it cannot prune desired number of nodes, it prunes as many as it can.
-//
-int Prune(		const GPFunctionLookup& functions, 
-				GPTree*					tree, 
-				int						numToPrune, // or ability to prune down to x nodes? 
-				const GPTreeNode*		preserveNode = NULL )
-{
-	// TODO
-	// Improvement would be not not randomly prune the leftover nodes after
-	// the main preserve tree is removed
-	// but to walk up the preserve tree making note of immediate parameters
-	// and only have those nodes to choose from
-	//
+// picks nodes for the mutations below
+struct AnyNode
+{
+	bool operator()( const GPTreeNode* ) const	{ return true; }
+};
+
+struct NodeWithParameters
+{
+	bool operator()( const GPTreeNode* node ) const	{ return node->parameters[ 0 ] != NULL; }
+};
 
-	GPConstSubtreeIter flattenedIter( tree );
+struct NodeReturning
+{
+	NodeReturning( const GPFunctionLookup& functions, GPTypeID type ) : m_functions( functions ), m_type( type ) {}
+
+	bool operator()( const GPTreeNode* node ) const	{ return m_functions.GetFunctionByID( node->functionID ).m_return_type == m_type; }
 
-	// if we have a node to preserve, we will remove its subtree
-	// and its direct parents from the iterator's selection list.
-	if ( preserveNode )
+	const GPFunctionLookup&	m_functions;
+	GPTypeID				m_type;
+};
+
+// ---------------------------------------------------------------------------
+// PickNode:
+//		Picks one of the nodes below node (not node itself) which predicate
+//		accepts, each as likely as any other, in a single walk of the tree
+//		and without allocating. num_seen is the number accepted so far, and
+//		picked is left alone if there are none.
+//
+template< class Predicate >
+void PickNode( const GPTreeNode* node, const Predicate& predicate, int& num_seen, const GPTreeNode*& picked )
+{
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
 	{
-		flattenedIter.IgnoreSubtree( preserveNode );
+		const GPTreeNode* child = node->parameters[ i ];
+		if ( child == NULL ) continue;
 
-		const GPTreeNode* parent = preserveNode->parent;
-		while( parent )
+		if ( predicate( child ) && GPRand() % ++num_seen == 0 )
 		{
-			flattenedIter.IgnoreNode( parent );
-			parent = parent->parent;
+			picked = child;
 		}
+		PickNode( child, predicate, num_seen, picked );
 	}
+}
 
-	int numPruned = 0;
-	while( numPruned < numToPrune && flattenedIter.Count() )
-	{
-		int randomNode = flattenedIter.Random( true );
-
-		const GPTreeNode*		node			= flattenedIter.GetNode( randomNode );
-		const GPFunctionDesc&	function_desc	= functions.GetFunctionByID( node->functionID );
+// picks a random function other than function taking the same parameters and returning the same type
+GPFuncID FindSameSignature( const GPFunctionLookup& functions, GPFuncID function )
+{
+	const GPFunctionDesc&	desc	= functions.GetFunctionByID( function );
+	GPFuncID				picked	= GPFunctionLookup::NULLFUNC;
+	int						num_seen = 0;
 
-		// remove this from the iterator now, since the following code will be deleting it
-		// NOTE: this means the iterator is set for the following loop before this one finishes
-		flattenedIter.IgnoreSubtree( node );
+	for( int i = 0; i < functions.GetNumFunctions(); ++i )
+	{
+		const GPFunctionDesc& other = functions.GetFunctionByID( i );
+		if ( i == function || other.m_return_type != desc.m_return_type || other.m_nparams != desc.m_nparams ) continue;
 
-		// if this node has parameters, then we will bother pruning it
-		bool canBePruned = false;
-		for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+		bool same = true;
+		for( int j = 0; j < desc.m_nparams; ++j )
 		{
-			if ( node->parameters[ i ] )
-			{
-				canBePruned = true;
-				break;
-			}
+			same = same && other.m_param_types[ j ] == desc.m_param_types[ j ];
 		}
 
-		if ( canBePruned )
+		if ( same && GPRand() % ++num_seen == 0 )
 		{
-			int nodes_used = 0;
-			GPTreeNode *replacement = CreateRandomTree(	functions, function_desc.m_return_type, nodes_used, 1 );
-			assert( replacement );
-
-			// do the prune with replacement
-			GPTreeNode* unusedSubtree = tree->Replace( node, replacement );
-
-			if ( unusedSubtree == node )
-			{
-				numPruned += GPTree::CountSubtree( unusedSubtree ) - 1;
-			}
-
-			delete	unusedSubtree;
+			picked = i;
 		}
-
 	}
 
-	return numPruned;
+	return picked;
 }
 
-int CalculatePotentialPrunes( const GPTreeNode* node )
+// picks a random function taking no parameters and returning return_type
+GPFuncID FindTerminal( const GPFunctionLookup& functions, GPTypeID return_type )
 {
-	// add its subtree count
-	int subtreeCount = GPTree::CountSubtree( node );
+	GPFuncID	picked		= GPFunctionLookup::NULLFUNC;
+	int			num_seen	= 0;
 
-	// and every branch off the parents which is not the main line (-1 for replacement node)
-	int potentialPrunes = 0;
-	const GPTreeNode *subtree		= node;
-	const GPTreeNode *subtreeParent = node->parent;
-	while( subtreeParent )
+	for( int i = 0; i < functions.GetNumFunctions(); ++i )
 	{
-		for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+		const GPFunctionDesc& desc = functions.GetFunctionByID( i );
+		if ( desc.m_nparams == 0 && desc.m_return_type == return_type && GPRand() % ++num_seen == 0 )
 		{
-			if ( subtreeParent->parameters[ i ] && subtreeParent->parameters[ i ] != subtree )
-			{
-				potentialPrunes += GPTree::CountSubtree( subtreeParent->parameters[ i ] ) - 1;
-			}
+			picked = i;
 		}
-		subtree			= subtreeParent;
-		subtreeParent	= subtreeParent->parent;
 	}
 
-	return subtreeCount + potentialPrunes;
+	return picked;
 }
 
-bool CrossOver( const GPFunctionLookup& functions, GPTree* sourceTree, GPTree* targetTree )
+// ---------------------------------------------------------------------------
+// PointMutate:
+//		Swaps the function of a random node for another taking the same
+//		parameters, so the tree keeps its shape and nothing is allocated.
+//
+//		Returns whether the tree was changed.
+//
+bool PointMutate( const GPFunctionLookup& functions, GPTree* tree )
 {
-	assert( sourceTree != targetTree );
-
-	GPConstSubtreeIter flattenedSource( sourceTree );
+	int					num_seen	= 1;
+	const GPTreeNode*	node		= tree->Root();
+	PickNode( tree->Root(), AnyNode(), num_seen, node );
 
-	const int			space_left_in_source	= sourceTree->MaxNodes() - sourceTree->Count();
-	const int			space_left_in_target	= targetTree->MaxNodes() - targetTree->Count();
-	const GPTreeNode*	selected_src_node		= NULL;
-	const GPTreeNode*	selected_target_node	= NULL;
-	int src_nodes_to_prune		= 0;
-	int target_nodes_to_prune	= 0;
-
-	while( flattenedSource.Count() && selected_target_node == NULL )
+	const GPFuncID function = FindSameSignature( functions, node->functionID );
+	if ( function == GPFunctionLookup::NULLFUNC )
 	{
-		// select random source node
-		const int			random_src_index	= flattenedSource.Random( true );
-		const GPTreeNode *	source_node			= flattenedSource.GetNode( random_src_index );
-		const int			src_potential_space	= CalculatePotentialPrunes( source_node ) + space_left_in_source;
-		const int			src_subtree_count	= GPTree::CountSubtree( source_node );
-
-		GPConstSubtreeIter flattened_target( targetTree );
-
-		// while still nodes in target,
-		while( flattened_target.Count() )
-		{
-			const GPFunctionDesc&	source_function_desc = functions.GetFunctionByID( source_node->functionID );
-
-			int random_target_node = flattened_target.Random( functions, source_function_desc.m_return_type, true );
-	
-			if ( random_target_node != GPConstSubtreeIter::INVALID_INDEX )
-			{
-				const GPTreeNode *target_node			= flattened_target.GetNode( random_target_node );
-				const int		target_potential_space	= CalculatePotentialPrunes( target_node ) + space_left_in_target;
-				const int		target_subtree_count	= GPTree::CountSubtree( target_node );
-
-				// can be swapped if subtree count of each fits within num_supported_replacement_nodes
-				const bool src_fits_in_target	= src_subtree_count		<= target_potential_space;
-				const bool targ_fits_in_src		= target_subtree_count	<= src_potential_space;
-				if ( src_fits_in_target && targ_fits_in_src ) 
-				{
-					selected_src_node		= source_node;
-					selected_target_node	= target_node;
-					src_nodes_to_prune		= target_subtree_count - src_subtree_count - space_left_in_source;
-					target_nodes_to_prune	= src_subtree_count - target_subtree_count - space_left_in_target;
-					break;
-				}
-
-				flattened_target.IgnoreNode( random_target_node );
-			}
-			else
-			{
-				break;
-			}
-		}
-
-		flattenedSource.IgnoreNode( random_src_index );
+		return false;
 	}
 
-	if ( selected_target_node != NULL )
-	{
-		if ( src_nodes_to_prune > 0 )
-		{
-			int n_pruned = Prune( functions, sourceTree, src_nodes_to_prune, selected_src_node );
-			assert( n_pruned >= src_nodes_to_prune );
-		}
-
-		if ( target_nodes_to_prune > 0 )
-		{
-			int n_pruned = Prune( functions, targetTree, target_nodes_to_prune, selected_target_node );
-			assert( n_pruned >= target_nodes_to_prune );
-		}
-
-		// TODO: Replace expects the first node to be within the 'source tree'
-		// so we need to duplicate the subtrees we're swapping. ideally have a BranchSwap()
-		// between the trees
-		GPTreeNode* duplicate_src_subtree		= GPTree::Duplicate( selected_src_node );
-		GPTreeNode* duplicate_target_subtree	= GPTree::Duplicate( selected_target_node );
-
-		GPTreeNode* leftOverSourceSubtree = sourceTree->Replace( selected_src_node, duplicate_target_subtree );
-		assert( leftOverSourceSubtree == selected_src_node );
+	tree->SetFunction( node, function );
+	return true;
+}
 
-		GPTreeNode* leftOverTargetSubtree = targetTree->Replace( selected_target_node, duplicate_src_subtree );
-		assert( leftOverTargetSubtree == selected_target_node );
+// ---------------------------------------------------------------------------
+// HoistMutate:
+//		Makes a random subtree returning the same type as the whole tree into
+//		the whole tree, throwing away the rest. Always shrinks the tree.
+//
+//		Returns whether the tree was changed.
+//
+bool HoistMutate( const GPFunctionLookup& functions, GPTree* tree )
+{
+	const GPTypeID		return_type	= functions.GetFunctionByID( tree->Root()->functionID ).m_return_type;
+	int					num_seen	= 0;
+	const GPTreeNode*	node		= NULL;
+	PickNode( tree->Root(), NodeReturning( functions, return_type ), num_seen, node );
 
-		delete leftOverSourceSubtree;
-		delete leftOverTargetSubtree;
+	if ( node == NULL )
+	{
+		return false;
 	}
 
-	return selected_target_node != NULL;
+	tree->Hoist( node );
+	return true;
 }
 
-GPEnvironment::GPEnvironment()
+// ---------------------------------------------------------------------------
+// ShrinkMutate:
+//		Replaces a random subtree (below the root) with a single terminal of
+//		the same type.
+//
+//		Returns whether the tree was changed.
+//
+bool ShrinkMutate( const GPFunctionLookup& functions, GPTree* tree )
 {
-	m_population_size		= 0;
-	m_population			= NULL;
-	m_fitness_and_test_func	= NULL;
-	m_fitness_func			= NULL;
-	m_max_tree_size			= 10;
-	m_return_type			= GP_INVALID_PARAMTYPE;
-}
+	int					num_seen	= 0;
+	const GPTreeNode*	node		= NULL;
+	PickNode( tree->Root(), NodeWithParameters(), num_seen, node );
 
-GPEnvironment::~GPEnvironment()
-{
-	for( int i = 0; i < m_population_size; ++i )
+	if ( node == NULL )
 	{
-		if ( m_population[ i ].m_tree ) delete m_population[ i ].m_tree;
+		return false;
 	}
-	if ( m_population ) delete m_population;
-}
 
-template<>
-GPFitness GPEnvironment::EvaluateAndFitnessTest<void>( int index )
-{
-	typedef GPFitness(*FitnessFunc)( GPEnvironment&, const int );
-	FitnessFunc custom_function = reinterpret_cast< FitnessFunc >( m_fitness_func );
-	ExecuteTree< void >( *this, m_population[ index ].m_tree->Root() );
-	return custom_function( *this, index );
-}
+	const GPFuncID terminal = FindTerminal( functions, functions.GetFunctionByID( node->functionID ).m_return_type );
+	if ( terminal == GPFunctionLookup::NULLFUNC )
+	{
+		return false;
+	}
 
-void GPEnvironment::SetFitnessFunction( GPFitness(*fitnessFunc)( GPEnvironment&, const int ) )
-{
-	m_return_type = GPGetTypeID< void >();
-	m_fitness_and_test_func = &GPEnvironment::EvaluateAndFitnessTest< void >;
+	GPTreeNode* spare_subtree = tree->Replace( node, new GPTreeNode( terminal ) );
+	assert( spare_subtree == node );
 
-	// TODO: assert that the void* can take the size of this pointer
-	m_fitness_func = reinterpret_cast<void*>(fitnessFunc);
+	GPTree::DeleteSubtree( spare_subtree );
+	return true;
 }
 
-void GPEnvironment::OverrideIndividualFitness( int index, GPFitness fitness )
+// true if some function taking no parameters returns return_type
+bool HasTerminal( const GPFunctionLookup& functions, GPTypeID return_type )
 {
-	m_population[ index ].m_current_fitness = fitness;
+	for( int i = 0; i < functions.GetNumFunctions(); ++i )
+	{
+		const GPFunctionDesc& desc = functions.GetFunctionByID( i );
+		if ( desc.m_nparams == 0 && desc.m_return_type == return_type )
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
-GPFitness GPEnvironment::EvaluateIndividual( int index )
+// ---------------------------------------------------------------------------
+// MaxPrunable:
+//		The most nodes collapsing subtrees of node to terminals can remove.
+//		That's all but one if node's type has a terminal, otherwise whatever
+//		its children can give up.
+//
+int MaxPrunable( const GPFunctionLookup& functions, const GPTreeNode* node )
 {
-	m_population[ index ].m_current_fitness = (*this.*m_fitness_and_test_func)( index );
-	return m_population[ index ].m_current_fitness;
-}
+	if ( HasTerminal( functions, functions.GetFunctionByID( node->functionID ).m_return_type ) )
+	{
+		return GPTree::CountSubtree( node ) - 1;
+	}
 
-void GPEnvironment::EvaluateAll()
-{
-	for( int i = 0; i < m_population_size; ++i )
+	int prunable = 0;
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
 	{
-		EvaluateIndividual( i );
+		if ( node->parameters[ i ] )
+		{
+			prunable += MaxPrunable( functions, node->parameters[ i ] );
+		}
 	}
+	return prunable;
 }
 
-int	GPEnvironment::GetPopulationSize() const
+// fills in the size of every subtree under node by preorder index, and the nodes
+// themselves if asked for. returns node's.
+int CalculateSubtreeSizes( const GPTreeNode* node, std::vector< int >& sizes, std::vector< const GPTreeNode* >* nodes = NULL )
 {
-	return m_population_size;
-}
+	const int index = static_cast< int >( sizes.size() );
+	sizes.push_back( 0 );
+	if ( nodes )
+	{
+		nodes->push_back( node );
+	}
 
-GPFitness	GPEnvironment::GetBestFitness() const
-{
-	GPFitness bestFit = -std::numeric_limits<double>::max();
-	for( int i = 0; i < m_population_size; ++i )
+	int size = 1;
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
 	{
-		if ( m_population[ i ].m_current_fitness > bestFit )
+		if ( node->parameters[ i ] )
 		{
-			bestFit = m_population[ i ].m_current_fitness;
+			size += CalculateSubtreeSizes( node->parameters[ i ], sizes, nodes );
 		}
 	}
 
-	return bestFit;
+	sizes[ index ] = size;
+	return size;
 }
 
-GPFitness GPEnvironment::GetIndividualFitness( int idx ) const
+// the numbers of nodes collapsing within a subtree can remove: which of those up to
+// the target, and the smallest beyond it (m_over, INT_MAX if there is none)
+struct PruneTable
 {
-	return m_population[ idx ].m_current_fitness;
-}
+	PruneTable() : m_reachable( 1, 1 ), m_over( std::numeric_limits< int >::max() ) {}
 
-GPFitness	GPEnvironment::GetAverageFitness() const
-{
-	// TODO: what to do if any value still has -std::numeric_limits<double>::max() ??
-	GPFitness total = 0;
-	for( int i = 0; i < m_population_size; ++i )
+	bool Reaches( int count ) const
 	{
-		total += m_population[ i ].m_current_fitness;
+		return count < static_cast< int >( m_reachable.size() ) ? count >= 0 && m_reachable[ count ] : count == m_over;
 	}
 
-	return total / m_population_size;
-}
+	void Add( int count, int target )
+	{
+		if ( count <= target )
+		{
+			if ( count >= static_cast< int >( m_reachable.size() ) ) m_reachable.resize( count + 1, 0 );
+			m_reachable[ count ] = 1;
+		}
+		else
+		{
+			m_over = std::min( m_over, count );
+		}
+	}
 
-int			GPEnvironment::GetFittestIndividual() const
+	std::vector< char >	m_reachable;
+	int					m_over;
+};
+
+// the counts reachable by pruning within two disjoint sets of subtrees together. anything
+// beyond the target is only worth knowing if it's the smallest.
+PruneTable CombinePruneTables( const PruneTable& a, const PruneTable& b, int target )
 {
-	int fittestIndex = 0;
-	GPFitness bestFit = -std::numeric_limits<double>::max();
-	for( int i = 0; i < m_population_size; ++i )
+	PruneTable combined;
+	combined.m_over = std::min( a.m_over, b.m_over );
+
+	for( int i = 0; i < static_cast< int >( a.m_reachable.size() ); ++i )
 	{
-		if ( m_population[ i ].m_current_fitness > bestFit )
+		if ( !a.m_reachable[ i ] ) continue;
+
+		for( int j = 0; j < static_cast< int >( b.m_reachable.size() ); ++j )
 		{
-			bestFit = m_population[ i ].m_current_fitness;
-			fittestIndex = i;
+			if ( b.m_reachable[ j ] )
+			{
+				combined.Add( i + j, target );
+			}
 		}
 	}
-	return fittestIndex;
-}
 
-const GPTree*	GPEnvironment::GetIndividualByIndex( int idx ) const
-{
-	return m_population[ idx ].m_tree;
+	return combined;
 }
 
-void GPEnvironment::SetIndividualReturnType( GPTypeID type )
+// a subtree Prune can remove nodes from, with the tables of what it can remove
+struct PrunePlan
 {
-	m_return_type = type;
-	m_fitness_func = NULL;
-}
+	const GPTreeNode*			m_node;
+	int							m_size;
+	bool						m_collapsible;
 
-void GPEnvironment::SetPopulationSize( int i )
-{
-	if ( m_population ) delete m_population;
+	// plans of the children which have children of their own. single nodes can't give anything up.
+	std::vector< int >			m_children;
 
-	m_population_size = i;
-	m_population = new Individual[ i ];
+	// m_prefixes[ k ] is what the first k children can remove between them
+	std::vector< PruneTable >	m_prefixes;
 
-	for( int i = 0; i < m_population_size; ++i )
+	// what the whole subtree can remove, collapsing it included
+	PruneTable					m_table;
+};
+
+// fills in the tables of a plan from its children's
+void CombinePrunePlan( PrunePlan& plan, const std::vector< PrunePlan >& plans, int target )
+{
+	plan.m_prefixes.assign( 1, PruneTable() );
+	for( size_t i = 0; i < plan.m_children.size(); ++i )
 	{
-		m_population[ i ].m_current_fitness = -std::numeric_limits<double>::max();
-		m_population[ i ].m_tree = NULL;
+		plan.m_prefixes.push_back( CombinePruneTables( plan.m_prefixes.back(), plans[ plan.m_children[ i ] ].m_table, target ) );
 	}
-}
 
-void GPEnvironment::SetMaxTreeSize( int i )
-{
-	m_max_tree_size = i;
+	plan.m_table = plan.m_prefixes.back();
+	if ( plan.m_collapsible )
+	{
+		plan.m_table.Add( plan.m_size - 1, target );
+	}
 }
 
-bool GPEnvironment::OverrideIndividual( int idx, GPTree* replacement )
+// plans the subtree under node, returning the index of its plan in plans, or -1 for a single
+// node. the size of the subtree is returned through size.
+int PlanPrune( const GPFunctionLookup& functions, const GPTreeNode* node, int target, std::vector< PrunePlan >& plans, int& size )
 {
-	assert( idx < GetPopulationSize() );
-
-	//
-	// ensure this replacement can fit our registered functions
-	//
-	GPConstSubtreeIter flattened( replacement );
+	std::vector< int > children;
 
-	for( int i = 0; i < flattened.Count(); ++i )
+	size = 1;
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
 	{
-		const GPTreeNode* this_node = flattened.GetNode( i );
+		if ( node->parameters[ i ] == NULL ) continue;
 
-		// if we dont have such an id, then it doesnt fit
-		if ( !FunctionIDExists( this_node->functionID ) ) return false;
+		int child_size;
+		const int child = PlanPrune( functions, node->parameters[ i ], target, plans, child_size );
+		if ( child >= 0 )
+		{
+			children.push_back( child );
+		}
+		size += child_size;
+	}
 
-		const GPFunctionDesc& this_function = GetFunctionByID( this_node->functionID );
+	if ( size == 1 )
+	{
+		return -1;
+	}
 
-		// check the parameter count & return types for the node
-		for( int j = 0; j < GP_MAX_PARAMETERS; ++j )
-		{
-			bool hasParam				= this_node->parameters[ j ] != NULL;
-			bool expectsParam			= this_function.m_nparams > j;
+	PrunePlan plan;
+	plan.m_node			= node;
+	plan.m_size			= size;
+	plan.m_collapsible	= HasTerminal( functions, functions.GetFunctionByID( node->functionID ).m_return_type );
+	plan.m_children.swap( children );
+	CombinePrunePlan( plan, plans, target );
 
-			if(  hasParam && !expectsParam || !hasParam && expectsParam ) return false;
-			if( !hasParam && !expectsParam ) continue;
+	plans.push_back( plan );
+	return static_cast< int >( plans.size() ) - 1;
+}
 
-			bool paramFunctionExists	= FunctionIDExists( this_node->parameters[ j ]->functionID );
+// removes exactly count nodes from the plan's subtree, which its table must reach
+void CarryOutPrune( const GPFunctionLookup& functions, GPTree* tree, const std::vector< PrunePlan >& plans, const PrunePlan& plan, int count )
+{
+	assert( plan.m_table.Reaches( count ) );
 
-			if ( !paramFunctionExists ) return false;
+	if ( count == 0 )
+	{
+		return;
+	}
 
-			const GPFunctionDesc& paramFunction = GetFunctionByID( this_node->parameters[ j ]->functionID );
+	if ( plan.m_collapsible && count == plan.m_size - 1 )
+	{
+		tree->Collapse( plan.m_node, FindTerminal( functions, functions.GetFunctionByID( plan.m_node->functionID ).m_return_type ) );
+		return;
+	}
 
-			GPFuncID hasType		= paramFunction.m_return_type;
-			GPFuncID expectsType	= this_function.m_param_types[ j ];
+	// split the count between the last child and those before it, working back to the first.
+	// a count beyond the target is the smallest, so only splits into one part's m_over and 0.
+	for( size_t k = plan.m_children.size(); k > 0 && count > 0; --k )
+	{
+		const PruneTable& before	= plan.m_prefixes[ k - 1 ];
+		const PrunePlan& child		= plans[ plan.m_children[ k - 1 ] ];
 
-			// TODO: functions are registered twice. delayed version first.
-			// the deserialize doesnt match up the expected types, so we have function linking to
-			// the delayed version of a parameter.
-			//
-			if ( hasType != expectsType ) return false;
+		int child_count = child.m_table.Reaches( count ) && before.Reaches( 0 ) ? count : -1;
+		for( int i = 0; child_count < 0 && i < static_cast< int >( child.m_table.m_reachable.size() ); ++i )
+		{
+			if ( child.m_table.m_reachable[ i ] && before.Reaches( count - i ) )
+			{
+				child_count = i;
+			}
 		}
-	}
+		assert( child_count >= 0 );
 
-	//
-	// if we passed the checks, we'll just do a replace on the individual in question
-	//
-	delete m_population[ idx ].m_tree;
-	m_population[ idx ].m_tree = replacement;
-	m_population[ idx ].m_current_fitness = -std::numeric_limits<double>::max();
+		CarryOutPrune( functions, tree, plans, child, child_count );
+		count -= child_count;
+	}
 
-	return true;
+	assert( count == 0 );
 }
 
-void GPEnvironment::GenerateNewPopulation()
+// ---------------------------------------------------------------------------
+// Prune:
+//		Removes num_to_prune nodes from the tree by collapsing subtrees to
+//		single terminals of the same type. Optionally a node can be specified
+//		which has to be preserved. This node and its direct parents will be
+//		guaranteed to still exist in the pruned tree. With no node to preserve
+//		the root is kept.
+//
+//		Every count of nodes that could be removed is worked out in one pass,
+//		as a subset sum over the subtree sizes bounded by num_to_prune: a
+//		subtree can give up all but one of its nodes (if its type has a
+//		terminal) or whatever its children can between them. The subtrees
+//		hanging off the preserved path are combined the same way. Exactly
+//		num_to_prune is removed if any set of collapses adds up to it, and
+//		otherwise the fewest more that can be. The collapses are then carried
+//		out, reusing each collapsed node.
+//
+//		Returns the number of nodes removed, which falls short of num_to_prune
+//		only if MaxPrunable says so.
+//
+int Prune(		const GPFunctionLookup& functions, 
+				GPTree*					tree, 
+				int						num_to_prune,
+				const GPTreeNode*		preserve_node = NULL )
 {
-	for( int i = 0; i < m_population_size; ++i )
+	if ( num_to_prune <= 0 || tree->Root() == NULL )
 	{
-		if ( m_population[ i ].m_tree ) delete m_population[ i ].m_tree;
-
-		int nodes_used;
-		m_population[ i ].m_current_fitness = -std::numeric_limits<double>::max();
-		m_population[ i ].m_tree = new GPTree( m_max_tree_size );
-
-		// todo: ensure this tree actually gets created and replace doesnt fail
-		m_population[ i ].m_tree->Replace( NULL, CreateRandomTree( *this, m_return_type, nodes_used, m_max_tree_size ) );
+		return 0;
 	}
-}
 
-void GPEnvironment::MutateAndCrossover()
-{
-	enum BREED_ACTION 
-	{
-		GP_KEEP,	// keep this individual as-is
-		GP_TWOWAY,	// do a 2-way crossover (both individuals automatically move to new pool)
-		GP_ONEWAY,	// do a 1-way crossover (only the target individual moves into the new gene pool)
-		GP_COPYOF,	// copy specified tree (overwriting the current one entirely)
-		GP_NEW		// generate an entirely new individual for this slot
-	};
-
-	enum BREED_INDEX_RELATIVITY
-	{
-		GP_RELATIVE,	// the 'partner' index for ActionInfo is relative to the current tree
-		GP_ABSOLUTE,	// the 'partner' index for ActionInfo is based on the original ranked list
-		GP_NOPARTNER
-	};
-
-	struct ActionInfo
-	{
-		BREED_ACTION	m_action;
-		bool			m_mutate;
-
-		// the index of the partner tree for our action (if the action requires one)
-		// this is either relative to the current tree, or an absolute index into ranked list
-		BREED_INDEX_RELATIVITY	m_partner_index_relativity;
-		int						m_partner_index; 
-
-		ActionInfo( BREED_ACTION action, bool mutate, BREED_INDEX_RELATIVITY relativity, int partner_index )
-			: m_action( action ), m_mutate( mutate ), m_partner_index_relativity( relativity ), m_partner_index( partner_index )
-		{
-		}
-	};
-
-	// TODO:
-	// at the moment effects are cumulative, so if a tree is mutated
-	// and later a tree wants to crossover with it, the crossover will happen with mutated version.
-	// ALSO:
-	// - only new trees will change the 'root' node, which means after some success is had
-	//   there will be no experimentation with the root node D:
-	// - any not specified by actions should maybe default to the last entry
-	// - if the successful nodes are count 1, crossovers and such are fail
-	ActionInfo actions[] = 
-	{
-		ActionInfo( GP_KEEP,	false,	GP_NOPARTNER,	0 ),
-		ActionInfo( GP_KEEP,	false,	GP_NOPARTNER,	0 ),
-		ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	0 ),
-		ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	0 ),
-		ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	1 ),
-		ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	1 ),
-		ActionInfo( GP_TWOWAY,	true,	GP_ABSOLUTE,	2 ),
-		ActionInfo( GP_TWOWAY,	true,	GP_ABSOLUTE,	1 ),
-		ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	0 ),
-		ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	1 ),
-		ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	0 ),
-		ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	1 ),
-		ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	2 ),
-		ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	3 ),
-		ActionInfo( GP_NEW,		false,	GP_NOPARTNER,	0 ),
-		ActionInfo( GP_NEW,		false,	GP_NOPARTNER,	0 ),
-		ActionInfo( GP_NEW,		false,	GP_NOPARTNER,	0 ),
-		ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	0 ),
-	};
-
-	int n_actions = sizeof( actions ) / sizeof( ActionInfo );
+	std::vector< PrunePlan > plans;
+	plans.reserve( tree->Count() );
 
 	//
-	// rank all the individuals by their fitness levels
+	// everything hanging off the preserved path (or the root) can be pruned
 	//
-	int *ranked_by_fitness	= new int[ m_population_size ];
-	int *original_rankings	= new int[ m_population_size ];
+	PrunePlan top;
+	top.m_node			= NULL;
+	top.m_size			= 0;
+	top.m_collapsible	= false;
 
-	// todo: better sorting algorithm needed!
-	int write_index = 0;
-	for( int i = 0; i < m_population_size; ++i )
+	const GPTreeNode* keep = preserve_node ? preserve_node : tree->Root();
+	for( const GPTreeNode* node = preserve_node ? preserve_node->parent : tree->Root(); node != NULL; node = node->parent )
 	{
-		ranked_by_fitness[ write_index ] = i;
-		int swap_index = write_index;
-		while( swap_index > 0 && m_population[ ranked_by_fitness[ swap_index ] ].m_current_fitness > m_population[ ranked_by_fitness[ swap_index - 1 ] ].m_current_fitness )
+		for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
 		{
-			int t = ranked_by_fitness[ swap_index ];
-			ranked_by_fitness[ swap_index ] = ranked_by_fitness[ swap_index - 1 ];
-			ranked_by_fitness[ swap_index - 1 ] = t;
-			--swap_index;
-		}
-		++write_index;
+			const GPTreeNode* child = node->parameters[ i ];
+			if ( child == NULL || child == keep ) continue;
+
+			int child_size;
+			const int plan = PlanPrune( functions, child, num_to_prune, plans, child_size );
+			if ( plan >= 0 )
+			{
+				top.m_children.push_back( plan );
+			}
+		}
+		keep = node;
+	}
+
+	CombinePrunePlan( top, plans, num_to_prune );
+
+	//
+	// the exact count if possible, otherwise the least over it, otherwise the most there is
+	//
+	const PruneTable& table = top.m_table;
+
+	int count = table.m_over;
+	if ( table.Reaches( num_to_prune ) )
+	{
+		count = num_to_prune;
+	}
+	else if ( count == std::numeric_limits< int >::max() )
+	{
+		for( count = static_cast< int >( table.m_reachable.size() ) - 1; !table.m_reachable[ count ]; --count );
+	}
+
+	CarryOutPrune( functions, tree, plans, top, count );
+	return count;
+}
+
+// ---------------------------------------------------------------------------
+// CalculatePotentialPrunes:
+//		The space a crossover can make by replacing node: its own subtree,
+//		plus whatever Prune can remove from the subtrees hanging off its path
+//		to the root.
+//
+int CalculatePotentialPrunes( const GPFunctionLookup& functions, const GPTreeNode* node )
+{
+	// add its subtree count
+	int subtreeCount = GPTree::CountSubtree( node );
+
+	// and every branch off the parents which is not the main line
+	int potentialPrunes = 0;
+	const GPTreeNode *subtree		= node;
+	const GPTreeNode *subtreeParent = node->parent;
+	while( subtreeParent )
+	{
+		for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+		{
+			if ( subtreeParent->parameters[ i ] && subtreeParent->parameters[ i ] != subtree )
+			{
+				potentialPrunes += MaxPrunable( functions, subtreeParent->parameters[ i ] );
+			}
+		}
+		subtree			= subtreeParent;
+		subtreeParent	= subtreeParent->parent;
+	}
+
+	return subtreeCount + potentialPrunes;
+}
+
+// ---------------------------------------------------------------------------
+// CrossOverFrom:
+//		One way crossover. Replaces a random subtree of tree with a copy of a
+//		subtree of donor returning the same type, pruning tree if needed to
+//		make room. The donor is only read, so needs no copy made to protect it.
+//
+//		Returns whether the tree was changed.
+//
+bool CrossOverFrom( const GPFunctionLookup& functions, GPTree* tree, const GPTree* donor )
+{
+	assert( tree != donor );
+
+	GPConstSubtreeIter flattened_tree( tree );
+
+	const int			space_left_in_tree	= tree->MaxNodes() - tree->Count();
+	const GPTreeNode*	selected_node		= NULL;
+	const GPTreeNode*	selected_donor_node	= NULL;
+	int nodes_to_prune = 0;
+
+	while( flattened_tree.Count() && selected_donor_node == NULL )
+	{
+		// select the random node to be replaced
+		const int			random_index	= flattened_tree.Random( true );
+		const GPTreeNode*	node			= flattened_tree.GetNode( random_index );
+		const int			potential_space	= CalculatePotentialPrunes( functions, node ) + space_left_in_tree;
+		const int			subtree_count	= GPTree::CountSubtree( node );
+
+		const GPFunctionDesc& function_desc = functions.GetFunctionByID( node->functionID );
+
+		GPConstSubtreeIter flattened_donor( donor );
+		while( flattened_donor.Count() )
+		{
+			const int random_donor_index = flattened_donor.Random( functions, function_desc.m_return_type, true );
+			if ( random_donor_index == GPConstSubtreeIter::INVALID_INDEX )
+			{
+				break;
+			}
+
+			const GPTreeNode*	donor_node			= flattened_donor.GetNode( random_donor_index );
+			const int			donor_subtree_count	= GPTree::CountSubtree( donor_node );
+
+			if ( donor_subtree_count <= potential_space )
+			{
+				selected_node		= node;
+				selected_donor_node	= donor_node;
+				nodes_to_prune		= donor_subtree_count - subtree_count - space_left_in_tree;
+				break;
+			}
+
+			flattened_donor.IgnoreNode( random_donor_index );
+		}
+
+		flattened_tree.IgnoreNode( random_index );
+	}
+
+	if ( selected_donor_node == NULL )
+	{
+		return false;
+	}
+
+	const int num_pruned = nodes_to_prune > 0 ? Prune( functions, tree, nodes_to_prune, selected_node ) : 0;
+
+	// a prune falling short leaves the tree too full for the copy, which Replace then
+	// hands back. the tree has only changed if something was pruned.
+	GPTreeNode* left_over = tree->Replace( selected_node, GPTree::Duplicate( selected_donor_node ) );
+	const bool replaced = left_over == selected_node;
+
+	GPTree::DeleteSubtree( left_over );
+	return replaced || num_pruned > 0;
+}
+
+// every node of a tree in preorder, with the size of the subtree under it
+struct SubtreeIndex
+{
+	explicit SubtreeIndex( const GPTree* tree )
+	{
+		m_sizes.reserve( tree->Count() );
+		m_nodes.reserve( tree->Count() );
+		CalculateSubtreeSizes( tree->Root(), m_sizes, &m_nodes );
+	}
+
+	int Count() const	{ return static_cast< int >( m_nodes.size() ); }
+
+	std::vector< int >					m_sizes;
+	std::vector< const GPTreeNode* >	m_nodes;
+};
+
+// puts a copy of donor_node in place of node, which the caller has made sure fits
+void ReplaceWithCopy( GPTree* tree, const GPTreeNode* node, const GPTreeNode* donor_node )
+{
+	GPTreeNode* left_over = tree->Replace( node, GPTree::Duplicate( donor_node ) );
+	assert( left_over == node );
+
+	GPTree::DeleteSubtree( left_over );
+}
+
+// ---------------------------------------------------------------------------
+// SizeFairCrossOver:
+//		One way crossover which picks the donated subtree by its size relative
+//		to the one it replaces, so offspring don't grow on average (Langdon's
+//		size fair crossover). A random subtree of tree is picked first. Donor
+//		subtrees of its type are then considered only if no more than twice
+//		its size plus one, and only if they fit without pruning. One the same
+//		size is picked as often as they make up the candidates, otherwise the
+//		smaller and larger candidates are weighted so the mean size change is
+//		zero.
+//
+//		Returns whether the tree was changed.
+//
+bool SizeFairCrossOver( const GPFunctionLookup& functions, GPTree* tree, const GPTree* donor )
+{
+	assert( tree != donor );
+
+	const SubtreeIndex	tree_index( tree );
+	const SubtreeIndex	donor_index( donor );
+	const int			space_left_in_tree = tree->MaxNodes() - tree->Count();
+
+	// the order the crossover points are tried in. non-root points first, as
+	// replacing the root is just a copy of some of the donor.
+	std::vector< int > order;
+	order.reserve( tree_index.Count() );
+	for( int i = 1; i < tree_index.Count(); ++i )
+	{
+		order.push_back( i );
+	}
+	for( size_t i = order.size(); i > 1; --i )
+	{
+		std::swap( order[ i - 1 ], order[ GPRand() % i ] );
+	}
+	order.push_back( 0 );
+
+	std::vector< int > smaller, equal, larger;
+	for( size_t i = 0; i < order.size(); ++i )
+	{
+		const GPTreeNode*	node		= tree_index.m_nodes[ order[ i ] ];
+		const int			size		= tree_index.m_sizes[ order[ i ] ];
+		const GPTypeID		return_type	= functions.GetFunctionByID( node->functionID ).m_return_type;
+		const int			max_size	= std::min( 2 * size + 1, size + space_left_in_tree );
+
+		smaller.clear();
+		equal.clear();
+		larger.clear();
+
+		long smaller_change	= 0;
+		long larger_change	= 0;
+		for( int j = 0; j < donor_index.Count(); ++j )
+		{
+			const int donor_size = donor_index.m_sizes[ j ];
+			if ( donor_size > max_size || functions.GetFunctionByID( donor_index.m_nodes[ j ]->functionID ).m_return_type != return_type )
+			{
+				continue;
+			}
+
+			if ( donor_size < size )
+			{
+				smaller.push_back( j );
+				smaller_change += size - donor_size;
+			}
+			else if ( donor_size == size )
+			{
+				equal.push_back( j );
+			}
+			else
+			{
+				larger.push_back( j );
+				larger_change += donor_size - size;
+			}
+		}
+
+		const size_t num_candidates = smaller.size() + equal.size() + larger.size();
+		if ( num_candidates == 0 )
+		{
+			continue;
+		}
+
+		// GPRand is 31 bits
+		const double pick = GPRand() / 2147483648.0;
+
+		const std::vector< int >* bin = &equal;
+		if ( pick >= static_cast< double >( equal.size() ) / num_candidates )
+		{
+			if ( smaller.empty() )
+			{
+				bin = &larger;
+			}
+			else if ( larger.empty() )
+			{
+				bin = &smaller;
+			}
+			else
+			{
+				// P(larger) * mean larger change == P(smaller) * mean smaller change
+				const double mean_smaller	= static_cast< double >( smaller_change ) / smaller.size();
+				const double mean_larger	= static_cast< double >( larger_change ) / larger.size();
+				bin = GPRand() / 2147483648.0 * ( mean_smaller + mean_larger ) < mean_smaller ? &larger : &smaller;
+			}
+		}
+
+		ReplaceWithCopy( tree, node, donor_index.m_nodes[ ( *bin )[ GPRand() % bin->size() ] ] );
+		return true;
+	}
+
+	return false;
+}
+
+// walks the region where tree and donor have the same shape, from index and donor_index down,
+// collecting the pairs of nodes returning the same type which could be exchanged within max_growth
+void FindCommonRegion(	const GPFunctionLookup&	functions,
+						const SubtreeIndex&		tree_index,
+						int						index,
+						const SubtreeIndex&		donor_index,
+						int						donor_index_at,
+						int						max_growth,
+						std::vector< std::pair< int, int > >& points )
+{
+	const GPFunctionDesc& desc			= functions.GetFunctionByID( tree_index.m_nodes[ index ]->functionID );
+	const GPFunctionDesc& donor_desc	= functions.GetFunctionByID( donor_index.m_nodes[ donor_index_at ]->functionID );
+
+	if ( desc.m_return_type != donor_desc.m_return_type )
+	{
+		return;
+	}
+
+	if ( donor_index.m_sizes[ donor_index_at ] - tree_index.m_sizes[ index ] <= max_growth )
+	{
+		points.push_back( std::make_pair( index, donor_index_at ) );
+	}
+
+	if ( desc.m_nparams != donor_desc.m_nparams )
+	{
+		return;
+	}
+
+	// the children line up by parameter
+	const GPTreeNode* node			= tree_index.m_nodes[ index ];
+	const GPTreeNode* donor_node	= donor_index.m_nodes[ donor_index_at ];
+
+	int child		= index + 1;
+	int donor_child	= donor_index_at + 1;
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+	{
+		if ( node->parameters[ i ] && donor_node->parameters[ i ] )
+		{
+			FindCommonRegion( functions, tree_index, child, donor_index, donor_child, max_growth, points );
+		}
+
+		if ( node->parameters[ i ] )
+		{
+			child += tree_index.m_sizes[ child ];
+		}
+		if ( donor_node->parameters[ i ] )
+		{
+			donor_child += donor_index.m_sizes[ donor_child ];
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// HomologousCrossOver:
+//		One way crossover which only exchanges subtrees at the same position
+//		in both trees (Poli and Langdon's one point crossover). The trees are
+//		walked together from the root while their nodes take the same number
+//		of parameters, and a random point of this common region is picked.
+//		The donated subtree so replaces one in the same context, keeping the
+//		structure the parents share. Points whose exchange would not fit are
+//		never considered, so nothing is pruned.
+//
+//		Returns whether the tree was changed.
+//
+bool HomologousCrossOver( const GPFunctionLookup& functions, GPTree* tree, const GPTree* donor )
+{
+	assert( tree != donor );
+
+	const SubtreeIndex tree_index( tree );
+	const SubtreeIndex donor_index( donor );
+
+	std::vector< std::pair< int, int > > points;
+	FindCommonRegion( functions, tree_index, 0, donor_index, 0, tree->MaxNodes() - tree->Count(), points );
+
+	if ( points.empty() )
+	{
+		return false;
+	}
+
+	// exchanging the roots is just a copy of the donor, so only do it if nothing else fits
+	const size_t first = points.size() > 1 && points[ 0 ].first == 0 ? 1 : 0;
+
+	const std::pair< int, int >& point = points[ first + GPRand() % ( points.size() - first ) ];
+	ReplaceWithCopy( tree, tree_index.m_nodes[ point.first ], donor_index.m_nodes[ point.second ] );
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Breeding actions
+//		MutateAndCrossover ranks the population by fitness, and applies the
+//		action at each rank to the individual holding that rank. Ranks beyond
+//		the end of the table use its last action.
+//
+enum BREED_ACTION 
+{
+	GP_KEEP,	// keep this individual as-is
+	GP_ONEWAY,	// do a 1-way crossover (only the target individual moves into the new gene pool)
+	GP_COPYOF,	// copy specified tree (overwriting the current one entirely)
+	GP_NEW		// generate an entirely new individual for this slot
+};
+
+enum BREED_INDEX_RELATIVITY
+{
+	GP_RELATIVE,	// the 'partner' index for ActionInfo is relative to the current tree
+	GP_ABSOLUTE,	// the 'partner' index for ActionInfo is based on the original ranked list
+	GP_NOPARTNER
+};
+
+struct ActionInfo
+{
+	BREED_ACTION	m_action;
+	bool			m_mutate;
+
+	// the index of the partner tree for our action (if the action requires one)
+	// this is either relative to the current tree, or an absolute index into ranked list
+	BREED_INDEX_RELATIVITY	m_partner_index_relativity;
+	int						m_partner_index; 
+
+	ActionInfo( BREED_ACTION action, bool mutate, BREED_INDEX_RELATIVITY relativity, int partner_index )
+		: m_action( action ), m_mutate( mutate ), m_partner_index_relativity( relativity ), m_partner_index( partner_index )
+	{
+	}
+};
+
+// TODO:
+// - only new trees will change the 'root' node, which means after some success is had
+//   there will be no experimentation with the root node D:
+// - any not specified by actions should maybe default to the last entry
+// - if the successful nodes are count 1, crossovers and such are fail
+static const ActionInfo kBreedActions[] = 
+{
+	ActionInfo( GP_KEEP,	false,	GP_NOPARTNER,	0 ),
+	ActionInfo( GP_KEEP,	false,	GP_NOPARTNER,	0 ),
+	ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	0 ),
+	ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	0 ),
+	ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	1 ),
+	ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	1 ),
+	ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	2 ),
+	ActionInfo( GP_ONEWAY,	true,	GP_ABSOLUTE,	1 ),
+	ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	0 ),
+	ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	1 ),
+	ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	0 ),
+	ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	1 ),
+	ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	2 ),
+	ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	3 ),
+	ActionInfo( GP_NEW,		false,	GP_NOPARTNER,	0 ),
+	ActionInfo( GP_NEW,		false,	GP_NOPARTNER,	0 ),
+	ActionInfo( GP_NEW,		false,	GP_NOPARTNER,	0 ),
+	ActionInfo( GP_COPYOF,	true,	GP_ABSOLUTE,	0 ),
+};
+
+static const int kNumBreedActions = sizeof( kBreedActions ) / sizeof( ActionInfo );
+
+// ---------------------------------------------------------------------------
+// CountSurvivingRanks:
+//		The number of leading ranks whose trees carry on into the next
+//		generation, by being kept, crossed over or used as a partner. Every
+//		individual ranked below these is overwritten, so all that matters about
+//		its fitness is that it falls below them.
+//
+int CountSurvivingRanks( int population_size )
+{
+	const BREED_ACTION repeated_action = kBreedActions[ kNumBreedActions - 1 ].m_action;
+	if ( repeated_action != GP_COPYOF && repeated_action != GP_NEW )
+	{
+		return population_size;
+	}
+
+	int surviving = 0;
+	for( int i = 0; i < kNumBreedActions; ++i )
+	{
+		const ActionInfo& action = kBreedActions[ i ];
+
+		if ( action.m_action != GP_COPYOF && action.m_action != GP_NEW )
+		{
+			surviving = std::max( surviving, i + 1 );
+		}
+
+		if ( action.m_partner_index_relativity == GP_ABSOLUTE )
+		{
+			surviving = std::max( surviving, action.m_partner_index + 1 );
+		}
+		else if ( action.m_partner_index_relativity == GP_RELATIVE )
+		{
+			surviving = std::max( surviving, i + action.m_partner_index + 1 );
+		}
+	}
+
+	return std::min( surviving, population_size );
+}
+
+GPEnvironment::GPEnvironment()
+{
+	m_population_size		= 0;
+	m_population			= NULL;
+	m_back_population		= NULL;
+	m_fitness_and_test_func	= NULL;
+	m_fitness_func			= NULL;
+	m_max_tree_size			= 10;
+	m_return_type			= GP_INVALID_PARAMTYPE;
+	m_static_invoke_lookup	= NULL;
+	m_static_invoke_ptr		= 0;
+	m_functions				= &m_own_functions;
+	m_num_cases				= 0;
+	m_select_case			= NULL;
+	m_noisy_fitness			= false;
+	m_bounded_fitness		= false;
+	m_execution_budget		= 0;
+	m_budget_penalty		= -std::numeric_limits<double>::max();
+	m_evaluator				= NULL;
+	m_num_worker_processes	= 0;
+	m_async_fitness			= false;
+	m_seconds_per_node		= 0;
+	m_breeding_threads		= 0;
+	m_init_method			= GP_INIT_RAMPED;
+	m_init_min_depth		= 2;
+	m_init_max_depth		= 6;
+	m_duplicate_retries		= 0;
+	m_subtree_mutation_size	= 0;
+	m_crossover				= GP_CROSSOVER_SUBTREE;
+	m_objectives			= 0;
+	m_lexicase_cases		= 0;
+	m_epsilon_lexicase		= false;
+	m_changes				= 0;
+
+	for( int i = 0; i < GP_NUM_MUTATIONS; ++i )
+	{
+		m_mutation_rates[ i ] = i == GP_MUTATE_SUBTREE ? 1 : 0;
+	}
+}
+
+GPEnvironment::~GPEnvironment()
+{
+	delete m_evaluator;
+
+	FreePopulation( m_population );
+	FreePopulation( m_back_population );
+}
+
+template<>
+GPFitness GPEnvironment::EvaluateAndFitnessTest<void>( int index, GPFitness )
+{
+	typedef GPFitness(*FitnessFunc)( GPEnvironment&, const int );
+	FitnessFunc custom_function = reinterpret_cast< FitnessFunc >( m_fitness_func );
+	ExecuteRoot< void >( m_population[ index ].m_tree->Root() );
+	return custom_function( *this, index );
+}
+
+void GPEnvironment::SetFitnessFunction( GPFitness(*fitnessFunc)( GPEnvironment&, const int ) )
+{
+	m_return_type = GPGetTypeID< void >();
+	m_fitness_and_test_func = &GPEnvironment::EvaluateAndFitnessTest< void >;
+	m_bounded_fitness = false;
+
+	// TODO: assert that the void* can take the size of this pointer
+	m_fitness_func = reinterpret_cast<void*>(fitnessFunc);
+
+	StopAsyncFitness();
+	m_fitness_cache.Clear();
+	UpdateStaticInvoke();
+	++m_changes;
+}
+
+void GPEnvironment::ShareFunctions( const GPFunctionLookup& functions )
+{
+	// the lookup has to be locked - if anyone could still register functions with it
+	// then environments on other threads could be reading it as it changes.
+	assert( functions.IsLocked() );
+	assert( m_own_functions.GetNumFunctions() == 0 );
+
+	m_functions = &functions;
+	++m_changes;
+}
+
+void GPEnvironment::UpdateStaticInvoke()
+{
+	// the root of every individual returns m_return_type, so the invoke
+	// function to use only needs looking up when either of these change
+	m_static_invoke_ptr = m_static_invoke_lookup ? m_static_invoke_lookup( m_return_type ) : 0;
+}
+
+void GPEnvironment::OverrideIndividualFitness( int index, GPFitness fitness )
+{
+	m_population[ index ].m_current_fitness = fitness;
+	m_population[ index ].m_dirty = false;
+	++m_changes;
+}
+
+bool GPEnvironment::IsIndividualDirty( int index ) const
+{
+	return m_population[ index ].m_dirty;
+}
+
+int GPEnvironment::CountSurvivors() const
+{
+	// with secondary objectives or lexicase selection a less fit individual can still
+	// survive, so there's no cutoff
+	if ( m_objectives || m_lexicase_cases )
+	{
+		return 0;
+	}
+
+	return CountSurvivingRanks( m_population_size );
+}
+
+GPFitness GPEnvironment::GetSurvivalCutoff() const
+{
+	const int surviving = CountSurvivors();
+
+	std::vector< GPFitness > known;
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		if ( !m_population[ i ].m_dirty )
+		{
+			known.push_back( m_population[ i ].m_current_fitness );
+		}
+	}
+
+	if ( surviving == 0 || static_cast< int >( known.size() ) < surviving )
+	{
+		return -std::numeric_limits<double>::max();
+	}
+
+	std::nth_element( known.begin(), known.begin() + surviving - 1, known.end(), std::greater< GPFitness >() );
+	return known[ surviving - 1 ];
+}
+
+void GPEnvironment::SetNoisyFitness( bool noisy )
+{
+	m_noisy_fitness = noisy;
+	++m_changes;
+}
+
+void GPEnvironment::MarkDirty( Individual& individual )
+{
+	individual.m_current_fitness = -std::numeric_limits<double>::max();
+	individual.m_dirty = true;
+	individual.m_evaluation_seconds = 0;
+
+	if ( individual.m_case_errors )
+	{
+		std::fill( individual.m_case_errors, individual.m_case_errors + m_lexicase_cases, std::numeric_limits<double>::max() );
+	}
+}
+
+GPFitness GPEnvironment::EvaluateBoundedFitnessTest( int index, GPFitness cutoff )
+{
+	typedef GPFitness(*FitnessFunc)( GPEnvironment&, const int, const GPFitness );
+	FitnessFunc custom_function = reinterpret_cast< FitnessFunc >( m_fitness_func );
+	return custom_function( *this, index, cutoff );
+}
+
+GPFitness GPEnvironment::EvaluateIndividual( int index )
+{
+	// with noisy fitness the known values are from earlier runs, so can't be used as a cutoff
+	const bool use_cutoff = m_bounded_fitness && !m_noisy_fitness;
+	++m_changes;
+	return EvaluateIndividual( index, use_cutoff ? GetSurvivalCutoff() : -std::numeric_limits<double>::max() );
+}
+
+GPFitness GPEnvironment::EvaluateIndividual( int index, GPFitness cutoff )
+{
+	Individual& individual = m_population[ index ];
+
+	if ( FindCachedFitness( individual ) )
+	{
+		return individual.m_current_fitness;
+	}
+
+	if ( m_evaluator )
+	{
+		m_evaluator->Submit( index, individual.m_tree, cutoff );
+		return CollectEvaluatorResult();
+	}
+
+	bool overrun;
+	double seconds;
+	const GPFitness fitness = RunFitnessTest( index, cutoff, overrun, seconds );
+	RecordFitness( index, fitness, cutoff, overrun, seconds );
+
+	return individual.m_current_fitness;
+}
+
+bool GPEnvironment::FindCachedFitness( Individual& individual )
+{
+	// the cache only holds the fitness, so a hit would leave the case errors unset
+	if ( !m_fitness_cache.IsEnabled() || m_noisy_fitness || m_lexicase_cases )
+	{
+		return false;
+	}
+
+	if ( m_fitness_cache.Find( individual.m_tree, individual.m_current_fitness ) )
+	{
+		// known now, as if evaluated. nothing was timed, so the time stays unknown.
+		individual.m_dirty				= false;
+		individual.m_evaluation_seconds	= 0;
+
+		m_stats.IncrementCounter( GPS_FITNESSCACHEHITS );
+		return true;
+	}
+
+	m_stats.IncrementCounter( GPS_FITNESSCACHEMISSES );
+	return false;
+}
+
+GPFitness GPEnvironment::RunFitnessTest( int index, GPFitness cutoff, bool& overrun, double& seconds )
+{
+	// if this assert fires there is no fitness function to run. with an async fitness
+	// function, the evaluator has been replaced by SetEvaluationThreads or similar.
+	assert( m_fitness_and_test_func );
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	GPFitness fitness;
+
+	GPExecutionBudget::Set( m_execution_budget );
+
+	overrun = false;
+	try
+	{
+		fitness = (*this.*m_fitness_and_test_func)( index, cutoff );
+	}
+	catch( const GPBudgetExceeded& )
+	{
+		fitness = m_budget_penalty;
+		overrun = true;
+	}
+
+	GPExecutionBudget::Set( 0 );
+
+	seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+	return fitness;
+}
+
+void GPEnvironment::RecordFitness( int index, GPFitness fitness, GPFitness cutoff, bool overrun, double seconds )
+{
+	Individual& individual = m_population[ index ];
+
+	individual.m_current_fitness = fitness;
+	individual.m_dirty = false;
+	individual.m_evaluation_seconds = seconds;
+
+	// evaluations cut short by the budget or the cutoff say little about the full cost
+	if ( !overrun && fitness >= cutoff && seconds > 0 )
+	{
+		const double sample = seconds / individual.m_tree->Count();
+		m_seconds_per_node = m_seconds_per_node == 0 ? sample : ( m_seconds_per_node * 0.9 + sample * 0.1 );
+	}
+
+	if ( overrun )
+	{
+		m_stats.IncrementCounter( GPS_BUDGETOVERRUNS );
+	}
+	else if ( fitness < cutoff )
+	{
+		// may have been cut short, so the fitness is only an upper bound. not worth caching.
+		m_stats.IncrementCounter( GPS_BELOWCUTOFF );
+	}
+	else if ( !m_noisy_fitness )
+	{
+		m_fitness_cache.Store( individual.m_tree, fitness );
+	}
+}
+
+GPFitness GPEnvironment::CollectEvaluatorResult()
+{
+	const GPEvaluator::Result result = m_evaluator->Collect();
+
+	if ( result.m_crashed )
+	{
+		// not cached, in case the crash was down to something other than the tree
+		m_population[ result.m_index ].m_current_fitness = m_budget_penalty;
+		m_population[ result.m_index ].m_dirty = false;
+		m_stats.IncrementCounter( GPS_WORKERCRASHES );
+	}
+	else
+	{
+		RecordFitness( result.m_index, result.m_fitness, result.m_cutoff, result.m_overrun, result.m_seconds );
+	}
+
+	return m_population[ result.m_index ].m_current_fitness;
+}
+
+GPFitness GPEnvironment::EvaluateForWorker( int index, GPTree* tree, GPFitness cutoff, bool& overrun, double& seconds )
+{
+	Individual& individual = m_population[ index ];
+
+	delete individual.m_tree;
+	individual.m_tree = tree;
+
+	// the cache recognises nodes by address, which the new tree may share with the old one
+	if ( individual.m_case_cache )
+	{
+		individual.m_case_cache->Clear();
+	}
+
+	return RunFitnessTest( index, cutoff, overrun, seconds );
+}
+
+void GPEnvironment::StartAsyncFitness( void(*start)( GPEnvironment&, const int ), int max_in_flight )
+{
+	delete m_evaluator;
+	m_evaluator = new GPAsyncEvaluator( *this, start, max_in_flight );
+	m_num_worker_processes = 0;
+	m_async_fitness = true;
+}
+
+void GPEnvironment::StopAsyncFitness()
+{
+	if ( m_async_fitness )
+	{
+		delete m_evaluator;
+		m_evaluator = NULL;
+		m_async_fitness = false;
+	}
+}
+
+void GPEnvironment::CompleteFitness( int index, GPFitness fitness )
+{
+	// if this assert fires SetAsyncFitnessFunction isn't in use
+	assert( m_async_fitness );
+	static_cast< GPAsyncEvaluator* >( m_evaluator )->Complete( index, fitness );
+}
+
+bool GPEnvironment::SetEvaluationWorkers( int num_workers )
+{
+	assert( !m_async_fitness );
+
+	delete m_evaluator;
+	m_evaluator = NULL;
+	m_num_worker_processes = 0;
+
+	if ( num_workers <= 0 )
+	{
+		return true;
+	}
+
+	GPWorkerPool* workers = new GPWorkerPool();
+	if ( !workers->Start( *this, num_workers ) )
+	{
+		delete workers;
+		return false;
+	}
+
+	m_evaluator = workers;
+	m_num_worker_processes = num_workers;
+	return true;
+}
+
+void GPEnvironment::SetEvaluationThreads( int num_threads )
+{
+	assert( !m_async_fitness );
+
+	delete m_evaluator;
+	m_evaluator = NULL;
+	m_num_worker_processes = 0;
+
+	if ( num_threads > 0 )
+	{
+		GPEvaluationThreads* threads = new GPEvaluationThreads();
+		threads->Start( *this, num_threads );
+		m_evaluator = threads;
+	}
+}
+
+void GPEnvironment::SetBreedingThreads( int num_threads )
+{
+	m_breeding_threads = num_threads;
+}
+
+void GPEnvironment::SetFitnessCacheSize( int max_entries )
+{
+	m_fitness_cache.SetMaxEntries( max_entries );
+}
+
+void GPEnvironment::SetExecutionBudget( long max_steps, GPFitness penalty )
+{
+	m_execution_budget	= max_steps;
+	m_budget_penalty	= penalty;
+
+	// fitnesses remembered from before may have been over (or under) the new budget
+	m_fitness_cache.Clear();
+}
+
+// keeps the best fitnesses known, for as many individuals as survive breeding
+static void AddBestKnown( std::priority_queue< GPFitness, std::vector< GPFitness >, std::greater< GPFitness > >& best_known, int surviving, GPFitness fitness )
+{
+	if ( surviving )
+	{
+		best_known.push( fitness );
+		if ( static_cast< int >( best_known.size() ) > surviving )
+		{
+			best_known.pop();
+		}
+	}
+}
+
+// orders individual indices fittest first, for ranking the population
+struct GPEnvironment::FitterIndividual
+{
+	FitterIndividual( const Individual* population ) : m_population( population ) {}
+
+	bool operator()( int a, int b ) const
+	{
+		return m_population[ a ].m_current_fitness > m_population[ b ].m_current_fitness;
+	}
+
+	const Individual* m_population;
+};
+
+void GPEnvironment::QueueEvaluation( int index, FitnessHeap& best_known, int surviving )
+{
+	GPFitness cutoff = -std::numeric_limits<double>::max();
+	if ( surviving && static_cast< int >( best_known.size() ) == surviving )
+	{
+		cutoff = best_known.top();
+	}
+
+	GPFitness fitness;
+	if ( m_evaluator == NULL )
+	{
+		fitness = EvaluateIndividual( index, cutoff );
+	}
+	else if ( FindCachedFitness( m_population[ index ] ) )
+	{
+		fitness = m_population[ index ].m_current_fitness;
+	}
+	else
+	{
+		// hand it to the next free worker, storing whichever results come back meanwhile
+		while( !m_evaluator->HasIdleWorker() )
+		{
+			AddBestKnown( best_known, surviving, CollectEvaluatorResult() );
+		}
+
+		m_evaluator->Submit( index, m_population[ index ].m_tree, cutoff );
+		return;
+	}
+
+	AddBestKnown( best_known, surviving, fitness );
+}
+
+void GPEnvironment::FinishEvaluations( FitnessHeap& best_known, int surviving )
+{
+	while( m_evaluator && m_evaluator->GetNumOutstanding() > 0 )
+	{
+		AddBestKnown( best_known, surviving, CollectEvaluatorResult() );
+	}
+}
+
+void GPEnvironment::EvaluateAll()
+{
+	// with a bounded fitness function, keep the best fitnesses known so far for as many
+	// individuals as survive breeding. the worst of those is the cutoff.
+	const int	surviving	= m_bounded_fitness ? CountSurvivors() : 0;
+	FitnessHeap	best_known;
+
+	for( int i = 0; i < m_population_size && surviving && !m_noisy_fitness; ++i )
+	{
+		if ( !m_population[ i ].m_dirty )
+		{
+			AddBestKnown( best_known, surviving, m_population[ i ].m_current_fitness );
+		}
+	}
+
+	// unchanged individuals already carry their fitness, unless it varies run to run
+	std::vector< std::pair< double, int > > to_evaluate;
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		if ( m_population[ i ].m_dirty || m_noisy_fitness )
+		{
+			to_evaluate.push_back( std::make_pair( m_evaluator ? EstimateEvaluationCost( m_population[ i ] ) : 0, i ) );
+		}
+	}
+
+	// when evaluating alongside each other, the costliest are started first so the
+	// cheap ones can fill in around them at the end
+	if ( m_evaluator )
+	{
+		std::stable_sort( to_evaluate.begin(), to_evaluate.end(), std::greater< std::pair< double, int > >() );
+	}
+
+	for( size_t i = 0; i < to_evaluate.size(); ++i )
+	{
+		QueueEvaluation( to_evaluate[ i ].second, best_known, surviving );
+	}
+
+	FinishEvaluations( best_known, surviving );
+}
+
+double GPEnvironment::EstimateEvaluationCost( const Individual& individual ) const
+{
+	// an unchanged tree (being re-evaluated for noisy fitness) takes as long as it did last time
+	if ( !individual.m_dirty && individual.m_evaluation_seconds > 0 )
+	{
+		return individual.m_evaluation_seconds;
+	}
+
+	// otherwise assume cost goes with size. before anything is timed, this only has to order them
+	return individual.m_tree->Count() * ( m_seconds_per_node > 0 ? m_seconds_per_node : 1.0 );
+}
+
+int	GPEnvironment::GetPopulationSize() const
+{
+	return m_population_size;
+}
+
+GPFitness	GPEnvironment::GetBestFitness() const
+{
+	GPFitness bestFit = -std::numeric_limits<double>::max();
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		if ( m_population[ i ].m_current_fitness > bestFit )
+		{
+			bestFit = m_population[ i ].m_current_fitness;
+		}
+	}
+
+	return bestFit;
+}
+
+GPFitness GPEnvironment::GetIndividualFitness( int idx ) const
+{
+	return m_population[ idx ].m_current_fitness;
+}
+
+GPFitness	GPEnvironment::GetAverageFitness() const
+{
+	// TODO: what to do if any value still has -std::numeric_limits<double>::max() ??
+	GPFitness total = 0;
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		total += m_population[ i ].m_current_fitness;
+	}
+
+	return total / m_population_size;
+}
+
+int			GPEnvironment::GetFittestIndividual() const
+{
+	int fittestIndex = 0;
+	GPFitness bestFit = -std::numeric_limits<double>::max();
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		if ( m_population[ i ].m_current_fitness > bestFit )
+		{
+			bestFit = m_population[ i ].m_current_fitness;
+			fittestIndex = i;
+		}
+	}
+	return fittestIndex;
+}
+
+const GPTree*	GPEnvironment::GetIndividualByIndex( int idx ) const
+{
+	return m_population[ idx ].m_tree;
+}
+
+void GPEnvironment::SetIndividualReturnType( GPTypeID type )
+{
+	m_return_type = type;
+	m_fitness_func = NULL;
+
+	StopAsyncFitness();
+	m_fitness_cache.Clear();
+	UpdateStaticInvoke();
+	++m_changes;
+}
+
+void GPEnvironment::SetPopulationSize( int i )
+{
+	FreePopulation( m_population );
+	FreePopulation( m_back_population );
+
+	m_population_size	= i;
+	m_population		= AllocatePopulation();
+	m_back_population	= AllocatePopulation();
+	AssignErrorRows();
+
+	// the workers' copies of the population have to be the same size as this one
+	if ( m_num_worker_processes )
+	{
+		SetEvaluationWorkers( m_num_worker_processes );
+	}
+
+	++m_changes;
+}
+
+GPEnvironment::Individual* GPEnvironment::AllocatePopulation() const
+{
+	Individual* population = new Individual[ m_population_size ];
+
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		population[ i ].m_current_fitness = -std::numeric_limits<double>::max();
+		population[ i ].m_dirty = true;
+		population[ i ].m_evaluation_seconds = 0;
+		population[ i ].m_tree = NULL;
+		population[ i ].m_case_cache = NULL;
+		population[ i ].m_case_errors = NULL;
+	}
+
+	return population;
+}
+
+void GPEnvironment::FreePopulation( Individual*& population )
+{
+	if ( population == NULL ) return;
+
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		delete population[ i ].m_tree;
+		delete population[ i ].m_case_cache;
+	}
+	delete[] population;
+
+	population = NULL;
+}
+
+void GPEnvironment::SetMaxTreeSize( int i )
+{
+	m_max_tree_size = i;
+	++m_changes;
+}
+
+bool GPEnvironment::OverrideIndividual( int idx, GPTree* replacement )
+{
+	assert( idx < GetPopulationSize() );
+
+	//
+	// ensure this replacement can fit our registered functions
+	//
+	GPConstSubtreeIter flattened( replacement );
+
+	for( int i = 0; i < flattened.Count(); ++i )
+	{
+		const GPTreeNode* this_node = flattened.GetNode( i );
+
+		// if we dont have such an id, then it doesnt fit
+		if ( !m_functions->FunctionIDExists( this_node->functionID ) ) return false;
+
+		const GPFunctionDesc& this_function = m_functions->GetFunctionByID( this_node->functionID );
+
+		// check the parameter count & return types for the node
+		for( int j = 0; j < GP_MAX_PARAMETERS; ++j )
+		{
+			bool hasParam				= this_node->parameters[ j ] != NULL;
+			bool expectsParam			= this_function.m_nparams > j;
+
+			if(  hasParam && !expectsParam || !hasParam && expectsParam ) return false;
+			if( !hasParam && !expectsParam ) continue;
+
+			bool paramFunctionExists	= m_functions->FunctionIDExists( this_node->parameters[ j ]->functionID );
+
+			if ( !paramFunctionExists ) return false;
+
+			const GPFunctionDesc& paramFunction = m_functions->GetFunctionByID( this_node->parameters[ j ]->functionID );
+
+			GPFuncID hasType		= paramFunction.m_return_type;
+			GPFuncID expectsType	= this_function.m_param_types[ j ];
+
+			// TODO: functions are registered twice. delayed version first.
+			// the deserialize doesnt match up the expected types, so we have function linking to
+			// the delayed version of a parameter.
+			//
+			if ( hasType != expectsType ) return false;
+		}
+	}
+
+	//
+	// if we passed the checks, we'll just do a replace on the individual in question
+	//
+	delete m_population[ idx ].m_tree;
+	m_population[ idx ].m_tree = replacement;
+	MarkDirty( m_population[ idx ] );
+	++m_changes;
+
+	return true;
+}
+
+void GPEnvironment::SetMutationRate( GPMutation mutation, double rate )
+{
+	assert( mutation >= 0 && mutation < GP_NUM_MUTATIONS && rate >= 0 );
+	m_mutation_rates[ mutation ] = rate;
+	++m_changes;
+}
+
+void GPEnvironment::SetSubtreeMutationSize( int max_nodes )
+{
+	m_subtree_mutation_size = max_nodes;
+	++m_changes;
+}
+
+bool GPEnvironment::Mutate( GPTree* tree ) const
+{
+	double total = 0;
+	for( int i = 0; i < GP_NUM_MUTATIONS; ++i )
+	{
+		total += m_mutation_rates[ i ];
+	}
+
+	if ( total <= 0 )
+	{
+		return false;
+	}
+
+	// GPRand is 31 bits
+	double pick = GPRand() / 2147483648.0 * total;
+
+	// rounding can leave pick past the end, so fall back to the last with a rate
+	int mutation = GP_MUTATE_SUBTREE;
+	for( int i = 0; i < GP_NUM_MUTATIONS; ++i )
+	{
+		if ( m_mutation_rates[ i ] > 0 )
+		{
+			mutation = i;
+			if ( pick < m_mutation_rates[ i ] ) break;
+			pick -= m_mutation_rates[ i ];
+		}
+	}
+
+	switch( mutation )
+	{
+	case GP_MUTATE_POINT :		return PointMutate( *m_functions, tree );
+	case GP_MUTATE_HOIST :		return HoistMutate( *m_functions, tree );
+	case GP_MUTATE_SHRINK :		return ShrinkMutate( *m_functions, tree );
+	default:					return MutateTree( *m_functions, tree, m_subtree_mutation_size );
+	}
+}
+
+void GPEnvironment::SetCrossover( GPCrossover crossover )
+{
+	m_crossover = crossover;
+	++m_changes;
+}
+
+bool GPEnvironment::Recombine( GPTree* tree, const GPTree* donor ) const
+{
+	switch( m_crossover )
+	{
+	case GP_CROSSOVER_SIZEFAIR :	return SizeFairCrossOver( *m_functions, tree, donor );
+	case GP_CROSSOVER_HOMOLOGOUS :	return HomologousCrossOver( *m_functions, tree, donor );
+	default:						return CrossOverFrom( *m_functions, tree, donor );
+	}
+}
+
+void GPEnvironment::SetSecondaryObjectives( int objectives )
+{
+	m_objectives = objectives;
+	++m_changes;
+}
+
+void GPEnvironment::SetLexicaseSelection( int num_cases, bool epsilon )
+{
+	assert( num_cases >= 0 );
+	m_lexicase_cases	= num_cases;
+	m_epsilon_lexicase	= epsilon;
+
+	AssignErrorRows();
+	++m_changes;
+}
+
+void GPEnvironment::SetCaseError( int index, int case_index, double error )
+{
+	assert( case_index >= 0 && case_index < m_lexicase_cases );
+	m_population[ index ].m_case_errors[ case_index ] = error;
+}
+
+void GPEnvironment::AssignErrorRows()
+{
+	m_error_matrix.assign( m_lexicase_cases * m_population_size, std::numeric_limits<double>::max() );
+	m_back_error_matrix.assign( m_lexicase_cases * m_population_size, std::numeric_limits<double>::max() );
+
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		m_population[ i ].m_case_errors			= m_lexicase_cases ? &m_error_matrix[ i * m_lexicase_cases ] : NULL;
+		m_back_population[ i ].m_case_errors	= m_lexicase_cases ? &m_back_error_matrix[ i * m_lexicase_cases ] : NULL;
+	}
+}
+
+void GPEnvironment::SetDuplicateRetries( int retries )
+{
+	m_duplicate_retries = retries;
+	++m_changes;
+}
+
+void GPEnvironment::SetInitialization( GPInitMethod method, int min_depth, int max_depth )
+{
+	assert( min_depth >= 0 && min_depth <= max_depth );
+
+	m_init_method		= method;
+	m_init_min_depth	= min_depth;
+	m_init_max_depth	= max_depth;
+}
+
+// ---------------------------------------------------------------------------
+// GenerateNewPopulation
+//		Builds every individual's tree with a GPTreeBuilder. Like Breed, each
+//		individual seeds the random generator from its index, so the trees are
+//		the same however many threads build them.
+//
+struct GPEnvironment::GenerateRun
+{
+	GenerateRun( const GPFunctionLookup& functions ) : m_builder( functions ) {}
+
+	GPTreeBuilder				m_builder;
+	unsigned long long			m_seed;
+	std::atomic< int >			m_next_index;
+};
+
+bool GPEnvironment::GenerateNewPopulation()
+{
+	GenerateRun run( *m_functions );
+
+	if ( !run.m_builder.CanBuild( m_return_type, m_max_tree_size ) )
+	{
+		m_init_error = run.m_builder.GetError();
+		return false;
+	}
+	m_init_error.clear();
+
+	run.m_seed = ( static_cast< unsigned long long >( GPRand() ) << 31 ) ^ GPRand();
+	run.m_next_index.store( 0 );
+
+	if ( m_breeding_threads <= 1 )
+	{
+		GenerateThread( run );
+	}
+	else
+	{
+		std::vector< std::thread > threads;
+		for( int i = 0; i < m_breeding_threads; ++i )
+		{
+			threads.push_back( std::thread( &GPEnvironment::GenerateThread, this, std::ref( run ) ) );
+		}
+
+		for( size_t i = 0; i < threads.size(); ++i )
+		{
+			threads[ i ].join();
+		}
+	}
+
+	GPSeedRand( run.m_seed + m_population_size );
+
+	// rebuilt in index order on this thread, so which tree of a pair is kept doesn't
+	// depend on the thread count either
+	if ( m_duplicate_retries > 0 )
+	{
+		std::unordered_set< GPHash > hashes;
+		int checks = 0, duplicates = 0, kept = 0;
+
+		for( int i = 0; i < m_population_size; ++i )
+		{
+			++checks;
+			for( int attempt = 0; !hashes.insert( m_population[ i ].m_tree->Hash() ).second; ++attempt )
+			{
+				++duplicates;
+				if ( attempt == m_duplicate_retries )
+				{
+					++kept;
+					break;
+				}
+
+				GenerateIndividual( run, i );
+			}
+		}
+
+		m_stats.IncrementCounter( GPS_DUPLICATECHECKS, checks );
+		m_stats.IncrementCounter( GPS_DUPLICATES, duplicates );
+		m_stats.IncrementCounter( GPS_DUPLICATESKEPT, kept );
+	}
+
+	++m_changes;
+	return true;
+}
+
+void GPEnvironment::GenerateThread( GenerateRun& run )
+{
+	for( ;; )
+	{
+		const int index = run.m_next_index++;
+		if ( index >= m_population_size ) return;
+
+		GPSeedRand( run.m_seed + index );
+		GenerateIndividual( run, index );
+	}
+}
+
+void GPEnvironment::GenerateIndividual( const GenerateRun& run, int index )
+{
+	int				max_depth	= m_init_max_depth;
+	GPBuildMethod	method		= m_init_method == GP_INIT_FULL ? GP_BUILD_FULL : GP_BUILD_GROW;
+
+	if ( m_init_method == GP_INIT_RAMPED )
+	{
+		// deal the individuals out over the depths, alternating the method at each
+		const int num_depths = m_init_max_depth - m_init_min_depth + 1;
+
+		max_depth	= m_init_min_depth + index % num_depths;
+		method		= ( index / num_depths ) % 2 ? GP_BUILD_FULL : GP_BUILD_GROW;
+	}
+
+	Individual& individual = m_population[ index ];
+	if ( individual.m_tree )
+	{
+		individual.m_tree->Clear( m_max_tree_size );
+	}
+	else
+	{
+		individual.m_tree = new GPTree( m_max_tree_size );
+	}
+
+	int nodes_used;
+	individual.m_tree->Replace( NULL, run.m_builder.Build( m_return_type, method, max_depth, m_max_tree_size, nodes_used ) );
+	MarkDirty( individual );
+
+	assert( individual.m_tree->Count() == nodes_used );
+}
+
+// ---------------------------------------------------------------------------
+// Breed
+//		Ranks the population, then produces the offspring for each rank on its
+//		own, into the individual with the rank's index. The population is
+//		double buffered: the parents are swapped into the back buffer, where
+//		they are only read until the whole generation is done, and each slot
+//		writes its offspring into its own individual in the front buffer. So
+//		slots can be produced in any order and on any number of threads, and
+//		the trees of the generation before last are recycled as the storage for
+//		the offspring. Each slot seeds the random generator from its rank, so
+//		the result doesn't depend on which thread produced it.
+//
+//		A slot keeping its parent as it is doesn't copy it. Once every slot is
+//		done, the parent's tree is swapped into the front buffer instead.
+//
+//		Slots BreedAhead already produced are kept if the final ranking gives
+//		them the same parent and partner, and produced again if not.
+//
+//		With evaluate set, each slot is queued for evaluation as soon as it is
+//		produced, and kept slots once they have been swapped in. Breed returns
+//		without waiting for the results (see FinishEvaluations).
+//
+
+// what producing one slot added to the stats
+struct BreedCounts
+{
+	int m_crossovers;
+	int m_failed_crossovers;
+	int m_duplicate_checks;
+	int m_duplicates;
+	int m_duplicates_kept;
+};
+
+struct GPEnvironment::BreedRun
+{
+	std::vector< int >			m_ranked;
+	const Individual*			m_parents;
+	Individual*					m_offspring;
+	unsigned long long			m_seed;
+	std::atomic< int >			m_next_rank;
+
+	// for each slot keeping its parent's tree as it is, the parent. -1 for the rest.
+	std::vector< int >			m_kept;
+
+	// m_changes as of the run starting, and the slots BreedAhead produced, with the
+	// parent and partner each was produced from (-1 for none)
+	unsigned int				m_changes;
+	bool						m_ahead;
+	std::vector< char >			m_bred;
+	std::vector< std::pair< int, int > >	m_bred_from;
+
+	// per slot, so a slot produced again isn't counted twice
+	std::vector< BreedCounts >	m_counts;
+
+	// structural hashes of the parents, when duplicates are being rejected
+	std::unordered_set< GPHash >	m_parent_hashes;
+
+	// with epsilon lexicase selection, how far within the lowest error on each case counts
+	std::vector< double >		m_epsilons;
+
+	// the fitnesses known so far for the bounded fitness cutoff, until the offspring are evaluated
+	FitnessHeap					m_best_known;
+	int							m_surviving;
+
+	// slots produced on the breeding threads, waiting to be queued for evaluation
+	std::mutex					m_lock;
+	std::condition_variable		m_produced;
+	std::deque< int >			m_ready;
+};
+
+void GPEnvironment::RankPopulation( std::vector< int >& ranked ) const
+{
+	if ( m_objectives == 0 )
+	{
+		ranked.resize( m_population_size );
+		for( int i = 0; i < m_population_size; ++i )
+		{
+			ranked[ i ] = i;
+		}
+
+		// stable, so equally fit individuals stay in population order
+		std::stable_sort( ranked.begin(), ranked.end(), FitterIndividual( m_population ) );
+		return;
+	}
+
+	//
+	// every objective is minimised, so fitness is negated
+	//
+	const int num_objectives = 1 + ( m_objectives & GP_OBJECTIVE_SIZE ? 1 : 0 ) + ( m_objectives & GP_OBJECTIVE_TIME ? 1 : 0 );
+
+	std::vector< double > objectives;
+	objectives.reserve( m_population_size * num_objectives );
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		const Individual& individual = m_population[ i ];
+
+		objectives.push_back( -individual.m_current_fitness );
+		if ( m_objectives & GP_OBJECTIVE_SIZE )
+		{
+			objectives.push_back( individual.m_tree->Count() );
+		}
+		if ( m_objectives & GP_OBJECTIVE_TIME )
+		{
+			objectives.push_back( EstimateEvaluationCost( individual ) );
+		}
+	}
+
+	GPRankNonDominated( objectives, num_objectives, ranked );
+}
+
+void GPEnvironment::StartBreedRun( BreedRun& run )
+{
+	run.m_seed = ( static_cast< unsigned long long >( GPRand() ) << 31 ) ^ GPRand();
+	ClearBreedRun( run );
+}
+
+void GPEnvironment::ClearBreedRun( BreedRun& run )
+{
+	run.m_changes	= m_changes;
+	run.m_ahead		= false;
+	run.m_kept.assign( m_population_size, -1 );
+	run.m_bred.assign( m_population_size, false );
+	run.m_bred_from.assign( m_population_size, std::make_pair( -1, -1 ) );
+	run.m_counts.assign( m_population_size, BreedCounts() );
+
+	run.m_parent_hashes.clear();
+	for( int i = 0; i < m_population_size && m_duplicate_retries > 0; ++i )
+	{
+		run.m_parent_hashes.insert( m_population[ i ].m_tree->Hash() );
+	}
+}
+
+void GPEnvironment::MutateAndCrossover()
+{
+	BreedRun run;
+	StartBreedRun( run );
+	Breed( run, false );
+}
+
+void GPEnvironment::Breed( BreedRun& run, bool evaluate )
+{
+	// anything bred ahead is out of date if the population or settings changed since
+	if ( run.m_changes != m_changes )
+	{
+		ClearBreedRun( run );
+	}
+
+	RankPopulation( run.m_ranked );
+
+	for( int rank = 0; rank < m_population_size; ++rank )
+	{
+		if ( run.m_bred[ rank ] )
+		{
+			int parent_index, partner_index;
+			FindSlotParents( run, rank, parent_index, partner_index );
+			run.m_bred[ rank ] = run.m_bred_from[ rank ] == std::make_pair( parent_index, partner_index );
+		}
+	}
+
+	std::swap( m_population, m_back_population );
+	run.m_parents	= m_back_population;
+	run.m_offspring	= m_population;
+	run.m_next_rank.store( 0 );
+
+	//
+	// epsilon lexicase keeps the parents within the median absolute deviation of the
+	// lowest error on each case. it only depends on the parents, so is found once here.
+	//
+	if ( m_lexicase_cases && m_epsilon_lexicase )
+	{
+		std::vector< double > column( m_population_size );
+		const std::vector< double >::iterator median = column.begin() + m_population_size / 2;
+
+		run.m_epsilons.resize( m_lexicase_cases );
+		for( int c = 0; c < m_lexicase_cases; ++c )
+		{
+			for( int i = 0; i < m_population_size; ++i )
+			{
+				column[ i ] = run.m_parents[ i ].m_case_errors[ c ];
+			}
+			std::nth_element( column.begin(), median, column.end() );
+
+			const double median_error = *median;
+			for( int i = 0; i < m_population_size; ++i )
+			{
+				column[ i ] = std::fabs( run.m_parents[ i ].m_case_errors[ c ] - median_error );
+			}
+			std::nth_element( column.begin(), median, column.end() );
+
+			run.m_epsilons[ c ] = *median;
+		}
+	}
+
+	run.m_surviving		= m_bounded_fitness ? CountSurvivors() : 0;
+	run.m_best_known	= FitnessHeap();
+	std::vector< int > kept;
+
+	//
+	// produce the offspring
+	//
+	if ( m_breeding_threads <= 1 )
+	{
+		for( int rank = 0; rank < m_population_size; ++rank )
+		{
+			if ( !run.m_bred[ rank ] )
+			{
+				BreedSlot( run, rank );
+			}
+			if ( evaluate )
+			{
+				ReleaseOffspring( run, rank, kept );
+			}
+		}
+	}
+	else
+	{
+		std::vector< std::thread > threads;
+		for( int i = 0; i < m_breeding_threads; ++i )
+		{
+			threads.push_back( std::thread( &GPEnvironment::BreedThread, this, std::ref( run ) ) );
+		}
+
+		for( int produced = 0; evaluate && produced < m_population_size; ++produced )
+		{
+			int index;
+			{
+				std::unique_lock< std::mutex > lock( run.m_lock );
+				while( run.m_ready.empty() )
+				{
+					run.m_produced.wait( lock );
+				}
+				index = run.m_ready.front();
+				run.m_ready.pop_front();
+			}
+
+			ReleaseOffspring( run, index, kept );
+		}
+
+		for( size_t i = 0; i < threads.size(); ++i )
+		{
+			threads[ i ].join();
+		}
 	}
 
-	memcpy( original_rankings, ranked_by_fitness, sizeof( int ) * m_population_size );
+	// leave this thread's generator the same however many threads bred, so the
+	// next generation is too
+	GPSeedRand( run.m_seed + m_population_size );
 
 	//
-	// apply the changes
+	// the parents are finished with, so the kept ones can move into the front buffer
 	//
-	int nLeftToProcess = m_population_size;
 	for( int i = 0; i < m_population_size; ++i )
 	{
-		//
-		// for each item in ranked fitness, apply the necessary change
-		// then remove it, and if it had a partner, remove that from the ranked fitness list
-		//
-		int partner_index;
-		int current_index	= ranked_by_fitness[ 0 ];
-		int action_index	= std::min( i, n_actions - 1 );
+		if ( run.m_kept[ i ] >= 0 )
+		{
+			std::swap( m_population[ i ].m_tree, m_back_population[ run.m_kept[ i ] ].m_tree );
+			std::swap( m_population[ i ].m_case_cache, m_back_population[ run.m_kept[ i ] ].m_case_cache );
+		}
+	}
+
+	BreedCounts total = BreedCounts();
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		total.m_crossovers			+= run.m_counts[ i ].m_crossovers;
+		total.m_failed_crossovers	+= run.m_counts[ i ].m_failed_crossovers;
+		total.m_duplicate_checks	+= run.m_counts[ i ].m_duplicate_checks;
+		total.m_duplicates			+= run.m_counts[ i ].m_duplicates;
+		total.m_duplicates_kept		+= run.m_counts[ i ].m_duplicates_kept;
+	}
+
+	m_stats.IncrementCounter( GPS_TOTALXOVERS, total.m_crossovers );
+	m_stats.IncrementCounter( GPS_FAILEDXOVERS, total.m_failed_crossovers );
+
+	if ( m_duplicate_retries > 0 )
+	{
+		m_stats.IncrementCounter( GPS_DUPLICATECHECKS, total.m_duplicate_checks );
+		m_stats.IncrementCounter( GPS_DUPLICATES, total.m_duplicates );
+		m_stats.IncrementCounter( GPS_DUPLICATESKEPT, total.m_duplicates_kept );
+	}
+
+	if ( evaluate )
+	{
+		for( size_t i = 0; i < kept.size(); ++i )
+		{
+			QueueEvaluation( kept[ i ], run.m_best_known, run.m_surviving );
+		}
+	}
+
+	++m_changes;
+}
+
+// ---------------------------------------------------------------------------
+// BreedAhead
+//		Called while some of the population are still being evaluated. Ranks
+//		the population by the fitnesses known so far, and produces each slot
+//		whose parent and partner have been evaluated into the back buffer, for
+//		Breed to keep if the final ranking agrees. Most slots only take from
+//		the top few ranks, so unless one of the last to be evaluated makes it
+//		in among them, nearly every slot is ready by the time the population is
+//		evaluated.
+//
+//		Lexicase selection picks parents by every individual's errors, and a
+//		noisy fitness re-evaluates every individual, so with either nothing is
+//		bred ahead.
+//
+void GPEnvironment::BreedAhead( BreedRun& run )
+{
+	const bool ahead = m_evaluator && m_evaluator->GetNumOutstanding() > 0 && m_lexicase_cases == 0 && !m_noisy_fitness;
 
-		const ActionInfo&	current_action = actions[ action_index ];
+	if ( ahead )
+	{
+		RankPopulation( run.m_ranked );
 
-		Individual&	current_individual = m_population[ current_index ];
+		run.m_parents	= m_population;
+		run.m_offspring	= m_back_population;
+		run.m_ahead		= true;
+		run.m_next_rank.store( 0 );
 
-		switch( current_action.m_partner_index_relativity )
+		if ( m_breeding_threads <= 1 )
 		{
-		case GP_RELATIVE :
+			for( int rank = 0; rank < m_population_size; ++rank )
 			{
-				assert( current_action.m_partner_index != 0 );
-				partner_index = ranked_by_fitness[ current_action.m_partner_index ];
-				break;
+				BreedSlotAhead( run, rank );
+			}
+		}
+		else
+		{
+			std::vector< std::thread > threads;
+			for( int i = 0; i < m_breeding_threads; ++i )
+			{
+				threads.push_back( std::thread( &GPEnvironment::BreedThread, this, std::ref( run ) ) );
 			}
-		case GP_ABSOLUTE :
+
+			for( size_t i = 0; i < threads.size(); ++i )
 			{
-				assert( current_action.m_partner_index >= 0 && current_action.m_partner_index < m_population_size );
-				partner_index = original_rankings[ current_action.m_partner_index ];
-				break;
+				threads[ i ].join();
 			}
-		default:
-			partner_index = 0;
 		}
 
-		assert( current_index < m_population_size && current_index >= 0 );
-		assert( partner_index < m_population_size && partner_index >= 0 );
-		switch( current_action.m_action )
+		run.m_ahead = false;
+	}
+
+	// leave this thread's generator as Breed will, however much was bred ahead
+	GPSeedRand( run.m_seed + m_population_size );
+}
+
+void GPEnvironment::BreedSlotAhead( BreedRun& run, int rank )
+{
+	int parent_index, partner_index;
+	FindSlotParents( run, rank, parent_index, partner_index );
+
+	// an individual still being evaluated may move anywhere in the ranking
+	if ( parent_index >= 0 && run.m_parents[ parent_index ].m_dirty ) return;
+	if ( partner_index >= 0 && run.m_parents[ partner_index ].m_dirty ) return;
+
+	BreedSlot( run, rank );
+
+	run.m_bred[ rank ]		= true;
+	run.m_bred_from[ rank ]	= std::make_pair( parent_index, partner_index );
+}
+
+// ---------------------------------------------------------------------------
+// RunGenerations
+//		Pipelines breeding with evaluation. Breed() queues each offspring for
+//		evaluation as soon as it has been produced, so the evaluator works
+//		through the offspring while the rest of the population is still being
+//		bred. Then while the last of a generation are being evaluated, the
+//		next generation is started with BreedAhead.
+//
+void GPEnvironment::RunGenerations( int generations, bool(*callback)( GPEnvironment&, const int ) )
+{
+	EvaluateAll();
+
+	// each generation's run starts while the one before is still being evaluated
+	BreedRun runs[ 2 ];
+	if ( generations > 0 )
+	{
+		StartBreedRun( runs[ 0 ] );
+	}
+
+	for( int generation = 0; generation < generations; ++generation )
+	{
+		BreedRun& run	= runs[ generation % 2 ];
+		BreedRun& next	= runs[ ( generation + 1 ) % 2 ];
+
+		Breed( run, true );
+
+		if ( generation + 1 < generations )
+		{
+			StartBreedRun( next );
+			BreedAhead( next );
+		}
+
+		FinishEvaluations( run.m_best_known, run.m_surviving );
+
+		if ( callback && !callback( *this, generation ) )
+		{
+			break;
+		}
+	}
+}
+
+void GPEnvironment::BreedThread( BreedRun& run )
+{
+	for( ;; )
+	{
+		const int rank = run.m_next_rank++;
+		if ( rank >= m_population_size ) return;
+
+		if ( run.m_ahead )
+		{
+			BreedSlotAhead( run, rank );
+			continue;
+		}
+
+		if ( !run.m_bred[ rank ] )
+		{
+			BreedSlot( run, rank );
+		}
+
+		{
+			std::lock_guard< std::mutex > lock( run.m_lock );
+			run.m_ready.push_back( rank );
+		}
+		run.m_produced.notify_one();
+	}
+}
+
+void GPEnvironment::FindSlotParents( const BreedRun& run, int rank, int& parent_index, int& partner_index ) const
+{
+	const ActionInfo& action = kBreedActions[ std::min( rank, kNumBreedActions - 1 ) ];
+
+	int partner_rank = -1;
+	switch( action.m_partner_index_relativity )
+	{
+	case GP_RELATIVE :
+		{
+			assert( action.m_partner_index != 0 );
+			partner_rank = rank + action.m_partner_index;
+			break;
+		}
+	case GP_ABSOLUTE :
+		{
+			partner_rank = action.m_partner_index;
+			break;
+		}
+	default:
+		break;
+	}
+
+	assert( partner_rank < m_population_size );
+
+	// copies and new trees don't start from the slot's own parent
+	const bool uses_parent = action.m_action == GP_KEEP || action.m_action == GP_ONEWAY;
+
+	parent_index	= uses_parent ? run.m_ranked[ rank ] : -1;
+	partner_index	= partner_rank >= 0 ? run.m_ranked[ partner_rank ] : -1;
+}
+
+void GPEnvironment::BreedSlot( BreedRun& run, int rank )
+{
+	const ActionInfo& action = kBreedActions[ std::min( rank, kNumBreedActions - 1 ) ];
+
+	GPSeedRand( run.m_seed + rank );
+
+	int parent_index, partner_index;
+	FindSlotParents( run, rank, parent_index, partner_index );
+
+	// with lexicase selection the rank only decides what is done, not who it is done with
+	if ( m_lexicase_cases && action.m_action != GP_KEEP )
+	{
+		parent_index = SelectByLexicase( run );
+		if ( partner_index >= 0 )
+		{
+			partner_index = SelectByLexicase( run );
+		}
+	}
+
+	const Individual*	parent		= parent_index >= 0 ? &run.m_parents[ parent_index ] : NULL;
+	const Individual*	partner		= partner_index >= 0 ? &run.m_parents[ partner_index ] : NULL;
+	Individual&			offspring	= run.m_offspring[ rank ];
+	BreedCounts&		counts		= run.m_counts[ rank ];
+
+	counts				= BreedCounts();
+	run.m_kept[ rank ]	= -1;
+
+	// the slot's storage, recycled from the generation before last
+	if ( offspring.m_tree == NULL )
+	{
+		offspring.m_tree = new GPTree( m_max_tree_size );
+	}
+
+	// a duplicate of a parent is produced again, while there are retries left
+	for( int attempt = 0; ; ++attempt )
+	{
+		switch( action.m_action )
 		{
 		case GP_KEEP :
 			{
-				// no action needed
-				break;
-			}
-		case GP_TWOWAY :
-			{
-				// no real way to handle failed crossover other than to make note it occurred
-				bool success = CrossOver( *this, current_individual.m_tree, m_population[ partner_index ].m_tree );
-				if ( !success )
+				if ( action.m_mutate )
+				{
+					CopyIntoOffspring( offspring, *parent );
+				}
+				else
 				{
-					m_stats.IncrementCounter( GPS_FAILEDXOVERS );
+					// the parent's tree is swapped in once the generation is done
+					offspring.m_current_fitness		= parent->m_current_fitness;
+					offspring.m_dirty				= parent->m_dirty;
+					offspring.m_evaluation_seconds	= parent->m_evaluation_seconds;
+					run.m_kept[ rank ] = parent_index;
+
+					if ( parent->m_case_errors )
+					{
+						std::copy( parent->m_case_errors, parent->m_case_errors + m_lexicase_cases, offspring.m_case_errors );
+					}
 				}
-				m_stats.IncrementCounter( GPS_TOTALXOVERS );
 				break;
 			}
 		case GP_ONEWAY :
 			{
-				// TODO:
-				// since our crossover will actually swap between two trees, an easy 'way out' is
-				// to duplicate the target so the original doesnt get modified during the operation
-				GPTree* target_copy = m_population[ partner_index ].m_tree->Duplicate();
-				bool success = CrossOver( *this, current_individual.m_tree, target_copy );
-				if ( !success )
+				CopyIntoOffspring( offspring, *parent );
+
+				if ( Recombine( offspring.m_tree, partner->m_tree ) )
+				{
+					MarkDirty( offspring );
+				}
+				else
 				{
-					m_stats.IncrementCounter( GPS_FAILEDXOVERS );
+					++counts.m_failed_crossovers;
 				}
-				m_stats.IncrementCounter( GPS_TOTALXOVERS );
-				delete target_copy;
+				++counts.m_crossovers;
 				break;
 			}
 		case GP_NEW :
 			{
 				int nodes_used;
-				delete current_individual.m_tree;
-				current_individual.m_tree = new GPTree( m_max_tree_size );
-				current_individual.m_tree->Replace( NULL, CreateRandomTree( *this, m_return_type, nodes_used, m_max_tree_size ) );
-				current_individual.m_current_fitness = -std::numeric_limits<double>::max();
-				assert( current_individual.m_tree->Count() > 0 );
+				offspring.m_tree->Clear( m_max_tree_size );
+				offspring.m_tree->Replace( NULL, CreateRandomTree( *m_functions, m_return_type, nodes_used, m_max_tree_size ) );
+				MarkDirty( offspring );
+				assert( offspring.m_tree->Count() > 0 );
 				break;
 			}
 		case GP_COPYOF:
 			{
-				delete current_individual.m_tree;
-				current_individual.m_tree = m_population[ partner_index ].m_tree->Duplicate();
-				current_individual.m_current_fitness = m_population[ partner_index ].m_current_fitness;
+				CopyIntoOffspring( offspring, *partner );
 				break;
 			}
 		};
 
-		if ( current_action.m_mutate )
+		if ( action.m_mutate )
+		{
+			if ( Mutate( offspring.m_tree ) )
+			{
+				MarkDirty( offspring );
+			}
+		}
+
+		if ( !RetryDuplicate( run, rank, attempt ) ) break;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// SelectByLexicase
+//		Starts with every parent as a candidate, then takes the cases one at a
+//		time in a random order, keeping only the candidates with the lowest
+//		error on each (or within its epsilon of the lowest). Stops once one is
+//		left or the cases run out, and picks at random from those left. The
+//		candidates are filtered in place, and the case order is shuffled only
+//		as far as it is used, in buffers each thread reuses, so a selection
+//		doesn't allocate.
+//
+int GPEnvironment::SelectByLexicase( const BreedRun& run ) const
+{
+	static thread_local std::vector< int > candidates;
+	static thread_local std::vector< int > cases;
+
+	candidates.resize( m_population_size );
+	for( int i = 0; i < m_population_size; ++i )
+	{
+		candidates[ i ] = i;
+	}
+
+	cases.resize( m_lexicase_cases );
+	for( int i = 0; i < m_lexicase_cases; ++i )
+	{
+		cases[ i ] = i;
+	}
+
+	int num_candidates	= m_population_size;
+	int num_cases		= m_lexicase_cases;
+	while( num_candidates > 1 && num_cases > 0 )
+	{
+		// draw the next case from those not used yet
+		const int pick		= GPRand() % num_cases;
+		const int test_case	= cases[ pick ];
+		cases[ pick ] = cases[ --num_cases ];
+
+		double lowest = run.m_parents[ candidates[ 0 ] ].m_case_errors[ test_case ];
+		for( int i = 1; i < num_candidates; ++i )
+		{
+			lowest = std::min( lowest, run.m_parents[ candidates[ i ] ].m_case_errors[ test_case ] );
+		}
+
+		const double threshold = m_epsilon_lexicase ? lowest + run.m_epsilons[ test_case ] : lowest;
+
+		int kept = 0;
+		for( int i = 0; i < num_candidates; ++i )
+		{
+			if ( run.m_parents[ candidates[ i ] ].m_case_errors[ test_case ] <= threshold )
+			{
+				candidates[ kept++ ] = candidates[ i ];
+			}
+		}
+
+		// errors which don't compare (NaN) can leave nothing, so the case is skipped
+		if ( kept > 0 )
+		{
+			num_candidates = kept;
+		}
+	}
+
+	return candidates[ GPRand() % num_candidates ];
+}
+
+// ---------------------------------------------------------------------------
+// RetryDuplicate
+//		True if the offspring just produced for a slot should be produced again,
+//		as it would need evaluating but is the same tree as one of the parents.
+//		Only parents are checked, since they're fixed while the slots are bred
+//		in any order, which keeps the results independent of the thread count.
+//
+bool GPEnvironment::RetryDuplicate( BreedRun& run, int index, int attempt )
+{
+	const Individual&	offspring	= run.m_offspring[ index ];
+	BreedCounts&		counts		= run.m_counts[ index ];
+
+	if ( m_duplicate_retries == 0 || run.m_kept[ index ] >= 0 || !offspring.m_dirty )
+	{
+		return false;
+	}
+
+	++counts.m_duplicate_checks;
+	if ( run.m_parent_hashes.count( offspring.m_tree->Hash() ) == 0 )
+	{
+		return false;
+	}
+
+	++counts.m_duplicates;
+	if ( attempt < m_duplicate_retries )
+	{
+		return true;
+	}
+
+	++counts.m_duplicates_kept;
+	return false;
+}
+
+void GPEnvironment::CopyIntoOffspring( Individual& offspring, const Individual& source )
+{
+	offspring.m_tree->CopyFrom( source.m_tree );
+	offspring.m_current_fitness		= source.m_current_fitness;
+	offspring.m_dirty				= source.m_dirty;
+	offspring.m_evaluation_seconds	= source.m_evaluation_seconds;
+
+	if ( source.m_case_errors )
+	{
+		std::copy( source.m_case_errors, source.m_case_errors + m_lexicase_cases, offspring.m_case_errors );
+	}
+
+	// start the copy with the source's cached case results too
+	if ( source.m_case_cache )
+	{
+		if ( offspring.m_case_cache == NULL )
 		{
-			MutateTree( *this, current_individual.m_tree );
-			current_individual.m_current_fitness = -std::numeric_limits<double>::max();
+			offspring.m_case_cache = new GPCaseCache();
 		}
+		offspring.m_case_cache->CopyFrom( *source.m_case_cache, source.m_tree, offspring.m_tree );
+	}
+	else if ( offspring.m_case_cache )
+	{
+		offspring.m_case_cache->Clear();
+	}
+}
+
+void GPEnvironment::ReleaseOffspring( BreedRun& run, int index, std::vector< int >& kept )
+{
+	const Individual& offspring = m_population[ index ];
+
+	if ( !offspring.m_dirty && !m_noisy_fitness )
+	{
+		AddBestKnown( run.m_best_known, run.m_surviving, offspring.m_current_fitness );
+	}
+	else if ( run.m_kept[ index ] >= 0 )
+	{
+		kept.push_back( index );
+	}
+	else
+	{
+		QueueEvaluation( index, run.m_best_known, run.m_surviving );
+	}
+}
+
+// ---------------------------------------------------------------------------
+// Steady state
+//		RunSteadyState breeds one offspring at a time, over the worst idle
+//		individual. The population is only locked while picking and copying
+//		parents and storing results, so the threads breed and evaluate side by
+//		side. Individuals a thread is working on are busy, and no other thread
+//		selects them until they are evaluated.
+//
+static const int kTournamentSize = 3;
+
+struct GPEnvironment::SteadyStateRun
+{
+	std::mutex			m_lock;
+	std::vector< bool >	m_busy;
+	int					m_remaining;
+};
+
+void GPEnvironment::RunSteadyState( int num_offspring, int num_threads )
+{
+	// if this assert fires, the threads would be sharing the evaluator
+	assert( m_evaluator == NULL );
+
+	// parents are picked by fitness, so every individual needs one to start with
+	EvaluateAll();
+
+	SteadyStateRun run;
+	run.m_busy.assign( m_population_size, false );
+	run.m_remaining = num_offspring;
+
+	std::vector< std::thread > threads;
+	for( int i = 0; i < num_threads; ++i )
+	{
+		threads.push_back( std::thread( &GPEnvironment::SteadyStateThread, this, std::ref( run ) ) );
+	}
+
+	for( size_t i = 0; i < threads.size(); ++i )
+	{
+		threads[ i ].join();
+	}
+
+	++m_changes;
+}
+
+int GPEnvironment::SelectByTournament( const SteadyStateRun& run ) const
+{
+	int winner = -1;
+	for( int i = 0; i < kTournamentSize; ++i )
+	{
+		const int entrant = GPRand() % m_population_size;
+		if ( run.m_busy[ entrant ] ) continue;
 
-		nLeftToProcess--;
-		for( int j = 0; j < nLeftToProcess; ++j )
+		if ( winner < 0 || m_population[ entrant ].m_current_fitness > m_population[ winner ].m_current_fitness )
 		{
-			ranked_by_fitness[ j ] = ranked_by_fitness[ j + 1 ];
+			winner = entrant;
 		}
 	}
 
-	delete[] ranked_by_fitness;
-	delete[] original_rankings;
+	// every entrant drawn was busy. settle for the first idle individual
+	for( int i = 0; i < m_population_size && winner < 0; ++i )
+	{
+		if ( !run.m_busy[ i ] ) winner = i;
+	}
+
+	return winner;
+}
+
+void GPEnvironment::SteadyStateThread( SteadyStateRun& run )
+{
+	for( ;; )
+	{
+		int			offspring_index;
+		int			partner_index;
+		GPFitness	cutoff = -std::numeric_limits<double>::max();
+
+		{
+			std::lock_guard< std::mutex > lock( run.m_lock );
+			if ( run.m_remaining == 0 ) return;
+
+			// the worst idle individual is replaced. the next worst is the cutoff, since
+			// an offspring scoring below that would be the next one replaced.
+			offspring_index = -1;
+			GPFitness next_worst = std::numeric_limits<double>::max();
+			for( int i = 0; i < m_population_size; ++i )
+			{
+				if ( run.m_busy[ i ] ) continue;
+
+				const GPFitness fitness = m_population[ i ].m_current_fitness;
+				if ( offspring_index < 0 || fitness < m_population[ offspring_index ].m_current_fitness )
+				{
+					if ( offspring_index >= 0 ) next_worst = m_population[ offspring_index ].m_current_fitness;
+					offspring_index = i;
+				}
+				else if ( fitness < next_worst )
+				{
+					next_worst = fitness;
+				}
+			}
+
+			if ( offspring_index < 0 ) return;
+			run.m_busy[ offspring_index ] = true;
+
+			const int parent_index	= SelectByTournament( run );
+			partner_index			= SelectByTournament( run );
+			if ( parent_index < 0 )
+			{
+				// more threads than individuals to go round
+				run.m_busy[ offspring_index ] = false;
+				return;
+			}
+
+			--run.m_remaining;
+
+			if ( m_bounded_fitness && !m_noisy_fitness && next_worst != std::numeric_limits<double>::max() )
+			{
+				cutoff = next_worst;
+			}
+
+			// the offspring's tree is recycled as the copy of the parent
+			CopyIntoOffspring( m_population[ offspring_index ], m_population[ parent_index ] );
+
+			// the partner is only read, outside the lock, so nothing may replace it meanwhile
+			run.m_busy[ partner_index ] = true;
+		}
+
+		Individual& offspring = m_population[ offspring_index ];
+
+		const bool crossed = Recombine( offspring.m_tree, m_population[ partner_index ].m_tree );
+		{
+			std::lock_guard< std::mutex > lock( run.m_lock );
+			run.m_busy[ partner_index ] = false;
+		}
+
+		const bool mutated = Mutate( offspring.m_tree );
+
+		// an unchanged copy keeps its parent's fitness
+		if ( !crossed && !mutated )
+		{
+			std::lock_guard< std::mutex > lock( run.m_lock );
+			run.m_busy[ offspring_index ] = false;
+			continue;
+		}
+
+		MarkDirty( offspring );
+
+		bool cached;
+		{
+			std::lock_guard< std::mutex > lock( run.m_lock );
+			cached = FindCachedFitness( offspring );
+		}
+
+		bool overrun = false;
+		double seconds = 0;
+		GPFitness fitness = offspring.m_current_fitness;
+		if ( !cached )
+		{
+			fitness = RunFitnessTest( offspring_index, cutoff, overrun, seconds );
+		}
+
+		std::lock_guard< std::mutex > lock( run.m_lock );
+		if ( !cached )
+		{
+			RecordFitness( offspring_index, fitness, cutoff, overrun, seconds );
+		}
+		run.m_busy[ offspring_index ] = false;
+	}
 }
 
 void GPEnvironment::TrackStats()
@@ -0,0 +1,287 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gpdefines.h"
+#include "gpenvironment.h"
+#include "gpevaluator.h"
+
+// jobs let queue up per thread, so one finishing never has to wait for the next to be submitted
+static const int kJobsPerThread = 2;
+
+GPEvaluationThreads::GPEvaluationThreads()
+{
+	m_environment	= NULL;
+	m_next_queue	= 0;
+	m_stopping		= false;
+	m_num_queued.store( 0 );
+	m_num_running.store( 0 );
+}
+
+GPEvaluationThreads::~GPEvaluationThreads()
+{
+	Stop();
+}
+
+void GPEvaluationThreads::Start( GPEnvironment& environment, int num_threads )
+{
+	Stop();
+
+	m_environment	= &environment;
+	m_stopping		= false;
+
+	for( int i = 0; i < num_threads; ++i )
+	{
+		m_queues.push_back( new JobQueue );
+	}
+
+	for( int i = 0; i < num_threads; ++i )
+	{
+		m_threads.push_back( std::thread( &GPEvaluationThreads::ThreadMain, this, i ) );
+	}
+}
+
+void GPEvaluationThreads::Stop()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_lock );
+		m_stopping = true;
+	}
+	m_job_added.notify_all();
+
+	for( size_t i = 0; i < m_threads.size(); ++i )
+	{
+		m_threads[ i ].join();
+	}
+
+	for( size_t i = 0; i < m_queues.size(); ++i )
+	{
+		delete m_queues[ i ];
+	}
+
+	m_threads.clear();
+	m_queues.clear();
+	m_results.clear();
+	m_num_queued.store( 0 );
+	m_num_running.store( 0 );
+	m_next_queue	= 0;
+	m_environment	= NULL;
+}
+
+bool GPEvaluationThreads::HasIdleWorker() const
+{
+	return m_num_queued.load() + m_num_running.load() < GetNumWorkers() * kJobsPerThread;
+}
+
+int GPEvaluationThreads::GetNumOutstanding() const
+{
+	std::lock_guard< std::mutex > lock( m_lock );
+	return m_num_queued.load() + m_num_running.load() + static_cast< int >( m_results.size() );
+}
+
+void GPEvaluationThreads::Submit( int index, const GPTree*, GPFitness cutoff )
+{
+	Job job;
+	job.m_index		= index;
+	job.m_cutoff	= cutoff;
+
+	// counted before it is queued, so a waiting thread can't miss it. at worst a
+	// thread wakes a moment early and looks again.
+	{
+		std::lock_guard< std::mutex > lock( m_lock );
+		++m_num_queued;
+	}
+
+	JobQueue& queue = *m_queues[ m_next_queue ];
+	m_next_queue = ( m_next_queue + 1 ) % static_cast< int >( m_queues.size() );
+
+	{
+		std::lock_guard< std::mutex > lock( queue.m_lock );
+		queue.m_jobs.push_back( job );
+	}
+
+	m_job_added.notify_one();
+}
+
+GPEvaluator::Result GPEvaluationThreads::Collect()
+{
+	std::unique_lock< std::mutex > lock( m_lock );
+
+	// if this assert fires nothing has been submitted, and this would wait forever
+	assert( !m_results.empty() || m_num_queued.load() > 0 || m_num_running.load() > 0 );
+
+	while( m_results.empty() )
+	{
+		m_result_added.wait( lock );
+	}
+
+	Result result = m_results.front();
+	m_results.pop_front();
+	return result;
+}
+
+// ---------------------------------------------------------------------------
+// TakeJob
+//		Takes the next job from the front of the thread's own queue, or if
+//		that is empty steals from the back of another thread's.
+//
+bool GPEvaluationThreads::TakeJob( int thread, Job& job )
+{
+	const int num_queues = static_cast< int >( m_queues.size() );
+	for( int i = 0; i < num_queues; ++i )
+	{
+		JobQueue& queue = *m_queues[ ( thread + i ) % num_queues ];
+		std::lock_guard< std::mutex > lock( queue.m_lock );
+
+		if ( queue.m_jobs.empty() ) continue;
+
+		if ( i == 0 )
+		{
+			job = queue.m_jobs.front();
+			queue.m_jobs.pop_front();
+		}
+		else
+		{
+			job = queue.m_jobs.back();
+			queue.m_jobs.pop_back();
+		}
+
+		++m_num_running;
+		--m_num_queued;
+		return true;
+	}
+
+	return false;
+}
+
+void GPEvaluationThreads::ThreadMain( int thread )
+{
+	for( ;; )
+	{
+		Job job;
+		if ( !TakeJob( thread, job ) )
+		{
+			std::unique_lock< std::mutex > lock( m_lock );
+			while( m_num_queued.load() == 0 && !m_stopping )
+			{
+				m_job_added.wait( lock );
+			}
+
+			if ( m_stopping ) return;
+			continue;
+		}
+
+		Result result;
+		result.m_index		= job.m_index;
+		result.m_cutoff		= job.m_cutoff;
+		result.m_crashed	= false;
+		result.m_fitness	= m_environment->RunFitnessTest( job.m_index, job.m_cutoff, result.m_overrun, result.m_seconds );
+
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			m_results.push_back( result );
+			--m_num_running;
+		}
+
+		m_result_added.notify_one();
+	}
+}
+
+GPAsyncEvaluator::GPAsyncEvaluator( GPEnvironment& environment, StartFuncPtr start, int max_in_flight )
+	: m_environment( environment )
+{
+	m_start			= start;
+	m_max_in_flight	= std::max( max_in_flight, 1 );
+}
+
+bool GPAsyncEvaluator::HasIdleWorker() const
+{
+	std::lock_guard< std::mutex > lock( m_lock );
+	return static_cast< int >( m_in_flight.size() ) < m_max_in_flight;
+}
+
+int GPAsyncEvaluator::GetNumOutstanding() const
+{
+	std::lock_guard< std::mutex > lock( m_lock );
+	return static_cast< int >( m_in_flight.size() + m_results.size() );
+}
+
+void GPAsyncEvaluator::Submit( int index, const GPTree*, GPFitness cutoff )
+{
+	{
+		std::lock_guard< std::mutex > lock( m_lock );
+
+		// if this assert fires the individual is already being measured
+		assert( m_in_flight.find( index ) == m_in_flight.end() );
+
+		Request& request	= m_in_flight[ index ];
+		request.m_cutoff	= cutoff;
+		request.m_start		= std::chrono::steady_clock::now();
+	}
+
+	// not locked, the start function is free to Complete() straight away
+	m_start( m_environment, index );
+}
+
+void GPAsyncEvaluator::Complete( int index, GPFitness fitness )
+{
+	{
+		std::lock_guard< std::mutex > lock( m_lock );
+
+		std::map< int, Request >::iterator found = m_in_flight.find( index );
+
+		// if this assert fires the individual wasn't being measured, or was completed twice
+		assert( found != m_in_flight.end() );
+		if ( found == m_in_flight.end() ) return;
+
+		Result result;
+		result.m_index		= index;
+		result.m_cutoff		= found->second.m_cutoff;
+		result.m_fitness	= fitness;
+		result.m_overrun	= false;
+		result.m_crashed	= false;
+		result.m_seconds	= std::chrono::duration< double >( std::chrono::steady_clock::now() - found->second.m_start ).count();
+
+		m_in_flight.erase( found );
+		m_results.push_back( result );
+	}
+
+	m_result_added.notify_one();
+}
+
+GPEvaluator::Result GPAsyncEvaluator::Collect()
+{
+	std::unique_lock< std::mutex > lock( m_lock );
+
+	// if this assert fires nothing has been submitted, and this would wait forever
+	assert( !m_in_flight.empty() || !m_results.empty() );
+
+	while( m_results.empty() )
+	{
+		m_result_added.wait( lock );
+	}
+
+	Result result = m_results.front();
+	m_results.pop_front();
+	return result;
+}
@@ -0,0 +1,126 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gpdefines.h"
+#include "gptree.h"
+#include "gpfitnesscache.h"
+
+static void AppendPreorder( const GPTreeNode* node, std::vector< GPFuncID >& functions )
+{
+	functions.push_back( node->functionID );
+
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+	{
+		if ( node->parameters[ i ] )
+		{
+			AppendPreorder( node->parameters[ i ], functions );
+		}
+	}
+}
+
+GPFitnessCache::GPFitnessCache()
+{
+	m_max_entries = 0;
+}
+
+void GPFitnessCache::SetMaxEntries( int max_entries )
+{
+	m_max_entries = max_entries;
+	Evict( max_entries );
+}
+
+void GPFitnessCache::Clear()
+{
+	m_entries.clear();
+	m_usage.clear();
+}
+
+void GPFitnessCache::MakeKey( const GPTree* tree )
+{
+	m_key.m_functions.clear();
+	if ( tree->Root() )
+	{
+		AppendPreorder( tree->Root(), m_key.m_functions );
+	}
+
+	m_key.m_hash = GPHashString( reinterpret_cast< const char* >( m_key.m_functions.data() ), m_key.m_functions.size() * sizeof( GPFuncID ) );
+}
+
+bool GPFitnessCache::Find( const GPTree* tree, GPFitness& fitness )
+{
+	if ( !IsEnabled() )
+	{
+		return false;
+	}
+
+	MakeKey( tree );
+
+	EntryMap::iterator iter = m_entries.find( m_key );
+	if ( iter == m_entries.end() )
+	{
+		return false;
+	}
+
+	m_usage.splice( m_usage.begin(), m_usage, iter->second.m_usage );
+	fitness = iter->second.m_fitness;
+	return true;
+}
+
+void GPFitnessCache::Store( const GPTree* tree, GPFitness fitness )
+{
+	if ( !IsEnabled() )
+	{
+		return;
+	}
+
+	MakeKey( tree );
+
+	EntryMap::iterator iter = m_entries.find( m_key );
+	if ( iter != m_entries.end() )
+	{
+		iter->second.m_fitness = fitness;
+		m_usage.splice( m_usage.begin(), m_usage, iter->second.m_usage );
+		return;
+	}
+
+	// make room first, so the entry being added is never the one evicted
+	Evict( m_max_entries - 1 );
+
+	Entry entry;
+	entry.m_fitness = fitness;
+	iter = m_entries.insert( EntryMap::value_type( m_key, entry ) ).first;
+
+	m_usage.push_front( &iter->first );
+	iter->second.m_usage = m_usage.begin();
+}
+
+void GPFitnessCache::Evict( int max_entries )
+{
+	while( !m_usage.empty() && static_cast< int >( m_entries.size() ) > max_entries )
+	{
+		const Key* oldest = m_usage.back();
+		m_usage.pop_back();
+		m_entries.erase( m_entries.find( *oldest ) );
+	}
+}
@@ -27,9 +27,11 @@
 
 GPFuncID GPFunctionLookup::NULLFUNC = -1;
 
+thread_local long GPExecutionBudget::s_remaining = std::numeric_limits< long >::max();
+
 GPFuncID GPFunctionLookup::GetRandomFuncWithReturnType( GPTypeID return_type_id ) const
 {
-	GPFuncID startFunc = rand() % m_nFuncs;
+	GPFuncID startFunc = GPRand() % m_nFuncs;
 	GPFuncID foundFunc = GetNextFuncWithReturnType( return_type_id, startFunc );
 
 	if ( foundFunc == NULLFUNC && m_functions[ startFunc ].m_return_type == return_type_id )
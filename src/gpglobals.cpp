@@ -41,4 +41,31 @@ GPHash GPHashString( const char* string, int size )
         hash = hash * FNVMultiple;		/* multiply by the magic number */
     }
     return hash;
-}
\ No newline at end of file
+}
+
+// zero marks a generator which hasn't been seeded yet
+static thread_local unsigned long long t_rand_state = 0;
+
+/*
+	SplitMix64, which gives well mixed output even from adjacent seeds (ie: the
+	same seed plus 1, 2, 3...), so it can be seeded per task.
+*/
+int GPRand()
+{
+	if ( t_rand_state == 0 )
+	{
+		GPSeedRand( ( static_cast< unsigned long long >( rand() ) << 32 ) ^ rand() );
+	}
+
+	unsigned long long z = ( t_rand_state += 0x9E3779B97F4A7C15ULL );
+	z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+	z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+	z = z ^ ( z >> 31 );
+
+	return static_cast< int >( z >> 33 );
+}
+
+void GPSeedRand( unsigned long long seed )
+{
+	t_rand_state = seed ? seed : 1;
+}
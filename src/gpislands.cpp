@@ -0,0 +1,224 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <thread>
+#include "gpdefines.h"
+#include "gpenvironment.h"
+#include "gpislands.h"
+
+GPIslands::GPIslands()
+{
+	m_interval		= 0;
+	m_num_migrants	= 0;
+	m_topology		= GPMIGRATE_RING;
+}
+
+GPIslands::~GPIslands()
+{
+	ClearInboxes();
+	for( size_t i = 0; i < m_islands.size(); ++i )
+	{
+		delete m_islands[ i ];
+	}
+}
+
+void GPIslands::AddIsland( GPEnvironment& island )
+{
+	Island* added = new Island;
+	added->m_environment = &island;
+	added->m_inbox.store( NULL );
+	m_islands.push_back( added );
+}
+
+int GPIslands::GetNumIslands() const
+{
+	return static_cast< int >( m_islands.size() );
+}
+
+GPEnvironment& GPIslands::GetIsland( int index ) const
+{
+	assert( index >= 0 && index < GetNumIslands() );
+	return *m_islands[ index ]->m_environment;
+}
+
+void GPIslands::SetMigration( int interval, int num_migrants, GPMigrationTopology topology )
+{
+	m_interval		= interval;
+	m_num_migrants	= num_migrants;
+	m_topology		= topology;
+}
+
+void GPIslands::Run( int generations )
+{
+	std::vector< std::thread > threads;
+	for( int i = 0; i < GetNumIslands(); ++i )
+	{
+		threads.push_back( std::thread( &GPIslands::RunIsland, this, i, generations ) );
+	}
+
+	for( size_t i = 0; i < threads.size(); ++i )
+	{
+		threads[ i ].join();
+	}
+
+	// islands which finished early may have been sent migrants after their last pickup
+	ClearInboxes();
+}
+
+int GPIslands::GetFittestIsland() const
+{
+	int fittest = 0;
+	for( int i = 1; i < GetNumIslands(); ++i )
+	{
+		if ( GetIsland( i ).GetBestFitness() > GetIsland( fittest ).GetBestFitness() )
+		{
+			fittest = i;
+		}
+	}
+	return fittest;
+}
+
+void GPIslands::RunIsland( int index, int generations )
+{
+	GPEnvironment& island	= GetIsland( index );
+	const bool migrating	= m_interval > 0 && m_num_migrants > 0 && GetNumIslands() > 1;
+
+	for( int generation = 1; generation <= generations; ++generation )
+	{
+		island.EvaluateAll();
+
+		if ( migrating && generation % m_interval == 0 )
+		{
+			Emigrate( index );
+			Immigrate( index );
+
+			// only the new arrivals are dirty
+			island.EvaluateAll();
+		}
+
+		island.MutateAndCrossover();
+	}
+
+	island.EvaluateAll();
+}
+
+void GPIslands::Emigrate( int index )
+{
+	const GPEnvironment& island = GetIsland( index );
+
+	std::vector< int > ranked( island.GetPopulationSize() );
+	for( size_t i = 0; i < ranked.size(); ++i )
+	{
+		ranked[ i ] = static_cast< int >( i );
+	}
+
+	const int num_migrants = std::min( m_num_migrants, island.GetPopulationSize() );
+	std::partial_sort( ranked.begin(), ranked.begin() + num_migrants, ranked.end(),
+		[&island]( int a, int b ) { return island.GetIndividualFitness( a ) > island.GetIndividualFitness( b ); } );
+
+	for( int i = 0; i < num_migrants; ++i )
+	{
+		int destination;
+		if ( m_topology == GPMIGRATE_RING )
+		{
+			destination = ( index + 1 ) % GetNumIslands();
+		}
+		else
+		{
+			// any island but this one
+			destination = GPRand() % ( GetNumIslands() - 1 );
+			if ( destination >= index ) ++destination;
+		}
+
+		Post( destination, island.GetIndividualByIndex( ranked[ i ] )->Duplicate() );
+	}
+}
+
+void GPIslands::Immigrate( int index )
+{
+	GPEnvironment& island = GetIsland( index );
+
+	Migrant* arrived = m_islands[ index ]->m_inbox.exchange( NULL );
+	if ( !arrived ) return;
+
+	std::vector< int > ranked( island.GetPopulationSize() );
+	for( size_t i = 0; i < ranked.size(); ++i )
+	{
+		ranked[ i ] = static_cast< int >( i );
+	}
+
+	// migrants replace the worst, but never more than half the population
+	const int max_replaced = island.GetPopulationSize() / 2;
+	std::partial_sort( ranked.begin(), ranked.begin() + max_replaced, ranked.end(),
+		[&island]( int a, int b ) { return island.GetIndividualFitness( a ) < island.GetIndividualFitness( b ); } );
+
+	int replaced = 0;
+	while( arrived )
+	{
+		Migrant* next = arrived->m_next;
+
+		// OverrideIndividual takes the tree, unless it doesn't fit this island's functions
+		if ( replaced >= max_replaced || !island.OverrideIndividual( ranked[ replaced ], arrived->m_tree ) )
+		{
+			delete arrived->m_tree;
+		}
+		else
+		{
+			++replaced;
+		}
+
+		delete arrived;
+		arrived = next;
+	}
+}
+
+void GPIslands::Post( int destination, GPTree* tree )
+{
+	std::atomic< Migrant* >& inbox = m_islands[ destination ]->m_inbox;
+
+	Migrant* migrant = new Migrant;
+	migrant->m_tree = tree;
+	migrant->m_next = inbox.load();
+
+	// on failure m_next is updated with the current head, so just try again
+	while( !inbox.compare_exchange_weak( migrant->m_next, migrant ) )
+	{
+	}
+}
+
+void GPIslands::ClearInboxes()
+{
+	for( size_t i = 0; i < m_islands.size(); ++i )
+	{
+		Migrant* migrant = m_islands[ i ]->m_inbox.exchange( NULL );
+		while( migrant )
+		{
+			Migrant* next = migrant->m_next;
+			delete migrant->m_tree;
+			delete migrant;
+			migrant = next;
+		}
+	}
+}
@@ -0,0 +1,400 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gpdefines.h"
+#include "gptree.h"
+#include "gpfunctionlookup.h"
+#include "gpjit.h"
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#define GP_JIT_SUPPORTED
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+GPJitOperations::GPJitOperations( const GPFunctionLookup& functions )
+	: m_functions( functions )
+{
+	for( int i = 0; i < GP_MAX_FUNCTIONS * 2; ++i )
+	{
+		m_operations[ i ] = GPJIT_NONE;
+	}
+}
+
+bool GPJitOperations::Allow( GPFuncID function, GPJitOperation operation )
+{
+	if ( !m_functions.FunctionIDExists( function ) )
+	{
+		assert( false );
+		return false;
+	}
+
+	const GPFunctionDesc& desc = m_functions.GetFunctionByID( function );
+	const GPTypeID double_type = GPGetTypeID< double >();
+
+	bool valid = desc.m_member_owner == 0 && desc.m_return_type == double_type;
+
+	switch( operation )
+	{
+	case GPJIT_ADD:
+	case GPJIT_SUB:
+	case GPJIT_MUL:
+	case GPJIT_PROTECTED_DIV:
+		valid = valid && desc.m_nparams == 2 && desc.m_param_types[ 0 ] == double_type && desc.m_param_types[ 1 ] == double_type;
+		break;
+	case GPJIT_CONSTANT:
+	case GPJIT_TERMINAL:
+		valid = valid && desc.m_nparams == 0;
+		break;
+	default:
+		break;
+	}
+
+	// if this assert fires, the function cannot be compiled as the given operation
+	assert( valid );
+	if ( valid )
+	{
+		m_operations[ function ] = operation;
+	}
+	return valid;
+}
+
+bool GPJitOperations::Allow( const char* name, GPJitOperation operation )
+{
+	GPFuncID function = m_functions.GetFunctionIDByName( name );
+	if ( function == GPFunctionLookup::NULLFUNC )
+	{
+		assert( false );
+		return false;
+	}
+
+	// the lookup may hand back the delayed version, which is never compilable
+	const GPFuncID original = m_functions.GetFunctionByID( function ).m_original_function_id;
+	return Allow( original != GPFunctionLookup::NULLFUNC ? original : function, operation );
+}
+
+GPJitOperation GPJitOperations::GetOperation( GPFuncID function ) const
+{
+	return m_functions.FunctionIDExists( function ) ? m_operations[ function ] : GPJIT_NONE;
+}
+
+namespace
+{
+	typedef double(*GPJitTerminalSignature)();
+
+	//
+	// Generates code for the System V and Win64 calling conventions, which agree
+	// on everything used here: no arguments, double returned in xmm0, xmm0-2 and
+	// rax free to clobber. Win64 additionally needs 32 bytes of shadow space
+	// below the stack pointer for calls.
+	//
+	// Each node leaves its value in xmm0. A binary node evaluates its left operand,
+	// spills it to the stack slot for its depth, evaluates the right, and combines.
+	// Terminals are called, so spilled values must live in memory rather than in
+	// caller-saved xmm registers.
+	//
+	class GPJitEmitter
+	{
+	public:
+		GPJitEmitter( const GPJitOperations& operations )
+			: m_operations( operations )
+			, m_functions( operations.GetFunctions() )
+		{
+		}
+
+		bool CanCompile( const GPTreeNode* node, int depth, int& max_depth ) const
+		{
+			if ( depth > max_depth )
+			{
+				max_depth = depth;
+			}
+
+			switch( m_operations.GetOperation( node->functionID ) )
+			{
+			case GPJIT_ADD:
+			case GPJIT_SUB:
+			case GPJIT_MUL:
+			case GPJIT_PROTECTED_DIV:
+				return CanCompile( node->parameters[ 0 ], depth, max_depth ) && CanCompile( node->parameters[ 1 ], depth + 1, max_depth );
+			case GPJIT_CONSTANT:
+			case GPJIT_TERMINAL:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		void EmitFunction( const GPTreeNode* root, int slots )
+		{
+			int frame = ( ( slots * 8 + 15 ) / 16 ) * 16;
+#if defined( _WIN32 )
+			frame += 32;
+#endif
+			Emit( 0x55 );							// push rbp
+			Emit( 0x48, 0x89, 0xE5 );				// mov rbp, rsp
+			Emit( 0x48, 0x81, 0xEC );				// sub rsp, frame
+			Emit32( frame );
+
+			EmitNode( root, 0 );
+
+			Emit( 0x48, 0x89, 0xEC );				// mov rsp, rbp
+			Emit( 0x5D );							// pop rbp
+			Emit( 0xC3 );							// ret
+		}
+
+		const std::vector< unsigned char >& GetCode() const	{ return m_code; }
+
+	private:
+		GPJitEmitter& operator=( const GPJitEmitter& );
+
+		void EmitNode( const GPTreeNode* node, int depth )
+		{
+			const GPJitOperation operation = m_operations.GetOperation( node->functionID );
+
+			if ( operation == GPJIT_CONSTANT || operation == GPJIT_TERMINAL )
+			{
+				GPJitTerminalSignature function;
+				memcpy( &function, m_functions.GetFunctionByID( node->functionID ).m_function_ptr, sizeof( function ) );
+
+				if ( operation == GPJIT_CONSTANT )
+				{
+					EmitLoadConstant( function() );
+				}
+				else
+				{
+					Emit( 0x48, 0xB8 );				// mov rax, function
+					Emit64( reinterpret_cast< uintptr_t >( function ) );
+					Emit( 0xFF, 0xD0 );				// call rax
+				}
+				return;
+			}
+
+			const int slot = -8 * ( depth + 1 );
+
+			EmitNode( node->parameters[ 0 ], depth );
+			Emit( 0xF2, 0x0F, 0x11, 0x85 );			// movsd [rbp + slot], xmm0
+			Emit32( slot );
+			EmitNode( node->parameters[ 1 ], depth + 1 );
+			Emit( 0x66, 0x0F, 0x28, 0xC8 );			// movapd xmm1, xmm0
+			Emit( 0xF2, 0x0F, 0x10, 0x85 );			// movsd xmm0, [rbp + slot]
+			Emit32( slot );
+
+			switch( operation )
+			{
+			case GPJIT_ADD:
+				Emit( 0xF2, 0x0F, 0x58, 0xC1 );		// addsd xmm0, xmm1
+				break;
+			case GPJIT_SUB:
+				Emit( 0xF2, 0x0F, 0x5C, 0xC1 );		// subsd xmm0, xmm1
+				break;
+			case GPJIT_MUL:
+				Emit( 0xF2, 0x0F, 0x59, 0xC1 );		// mulsd xmm0, xmm1
+				break;
+			case GPJIT_PROTECTED_DIV:
+				Emit( 0x66, 0x0F, 0x57, 0xD2 );		// xorpd xmm2, xmm2
+				Emit( 0x66, 0x0F, 0x2E, 0xCA );		// ucomisd xmm1, xmm2
+				Emit( 0x7A, 19 );					// jp divide (NaN divides, as in C++)
+				Emit( 0x75, 17 );					// jne divide
+				EmitLoadConstant( 1.0 );			// 15 bytes
+				Emit( 0xEB, 4 );					// jmp done
+				Emit( 0xF2, 0x0F, 0x5E, 0xC1 );		// divide: divsd xmm0, xmm1
+				break;								// done:
+			default:
+				assert( false );
+				break;
+			}
+		}
+
+		void EmitLoadConstant( double value )
+		{
+			uint64_t bits;
+			memcpy( &bits, &value, sizeof( bits ) );
+
+			Emit( 0x48, 0xB8 );						// mov rax, bits
+			Emit64( bits );
+			Emit( 0x66, 0x48, 0x0F, 0x6E, 0xC0 );	// movq xmm0, rax
+		}
+
+		void Emit( unsigned char b0 )
+		{
+			m_code.push_back( b0 );
+		}
+		void Emit( unsigned char b0, unsigned char b1 )
+		{
+			Emit( b0 ); Emit( b1 );
+		}
+		void Emit( unsigned char b0, unsigned char b1, unsigned char b2 )
+		{
+			Emit( b0 ); Emit( b1 ); Emit( b2 );
+		}
+		void Emit( unsigned char b0, unsigned char b1, unsigned char b2, unsigned char b3 )
+		{
+			Emit( b0 ); Emit( b1 ); Emit( b2 ); Emit( b3 );
+		}
+		void Emit( unsigned char b0, unsigned char b1, unsigned char b2, unsigned char b3, unsigned char b4 )
+		{
+			Emit( b0 ); Emit( b1 ); Emit( b2 ); Emit( b3 ); Emit( b4 );
+		}
+		void Emit32( int32_t value )
+		{
+			for( int i = 0; i < 4; ++i )
+			{
+				Emit( static_cast< unsigned char >( static_cast< uint32_t >( value ) >> ( i * 8 ) ) );
+			}
+		}
+		void Emit64( uint64_t value )
+		{
+			for( int i = 0; i < 8; ++i )
+			{
+				Emit( static_cast< unsigned char >( value >> ( i * 8 ) ) );
+			}
+		}
+
+		const GPJitOperations&		m_operations;
+		const GPFunctionLookup&		m_functions;
+		std::vector< unsigned char >	m_code;
+	};
+
+	void* GPJitAllocateCode( const std::vector< unsigned char >& code )
+	{
+#if defined( _WIN32 )
+		void* memory = VirtualAlloc( NULL, code.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+		if ( memory == NULL )
+		{
+			return NULL;
+		}
+		memcpy( memory, &code[ 0 ], code.size() );
+
+		DWORD old_protection;
+		if ( !VirtualProtect( memory, code.size(), PAGE_EXECUTE_READ, &old_protection ) )
+		{
+			VirtualFree( memory, 0, MEM_RELEASE );
+			return NULL;
+		}
+		FlushInstructionCache( GetCurrentProcess(), memory, code.size() );
+		return memory;
+#else
+		// mapped writable first and then flipped, so the pages are never writable and executable at once
+		void* memory = mmap( NULL, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if ( memory == MAP_FAILED )
+		{
+			return NULL;
+		}
+		memcpy( memory, &code[ 0 ], code.size() );
+
+		if ( mprotect( memory, code.size(), PROT_READ | PROT_EXEC ) != 0 )
+		{
+			munmap( memory, code.size() );
+			return NULL;
+		}
+		return memory;
+#endif
+	}
+
+	void GPJitFreeCode( void* code, size_t size )
+	{
+#if defined( _WIN32 )
+		(void)size;
+		VirtualFree( code, 0, MEM_RELEASE );
+#else
+		munmap( code, size );
+#endif
+	}
+}
+
+GPJitTree::GPJitTree()
+{
+	m_code			= NULL;
+	m_code_size		= 0;
+	m_functions		= NULL;
+	m_fallback		= NULL;
+}
+
+GPJitTree::~GPJitTree()
+{
+	Release();
+}
+
+bool GPJitTree::Compile( const GPJitOperations& operations, const GPTree* tree )
+{
+	Release();
+
+	m_functions = &operations.GetFunctions();
+
+#ifdef GP_JIT_SUPPORTED
+	GPJitEmitter emitter( operations );
+
+	int max_depth = 0;
+	if ( emitter.CanCompile( tree->Root(), 0, max_depth ) )
+	{
+		emitter.EmitFunction( tree->Root(), max_depth + 1 );
+
+		m_code = GPJitAllocateCode( emitter.GetCode() );
+		if ( m_code )
+		{
+			m_code_size = emitter.GetCode().size();
+			return true;
+		}
+	}
+#endif
+
+	m_fallback = tree->Duplicate();
+	return false;
+}
+
+bool GPJitTree::IsCompiled() const
+{
+	return m_code != NULL;
+}
+
+void GPJitTree::Release()
+{
+#ifdef GP_JIT_SUPPORTED
+	if ( m_code )
+	{
+		GPJitFreeCode( m_code, m_code_size );
+	}
+#endif
+	m_code		= NULL;
+	m_code_size	= 0;
+
+	delete m_fallback;
+	m_fallback	= NULL;
+}
+
+double GPJitTree::Execute() const
+{
+	if ( m_code )
+	{
+		return reinterpret_cast< CompiledSignature >( m_code )();
+	}
+
+	// if this assert fires, Compile was never called
+	assert( m_fallback );
+	return ExecuteTree< double >( *m_functions, m_fallback->Root() );
+}
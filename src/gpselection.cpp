@@ -0,0 +1,183 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gpselection.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+// orders points lexicographically on their objectives
+struct LexicographicLess
+{
+	LexicographicLess( const double* objectives, int num_objectives ) : m_objectives( objectives ), m_num_objectives( num_objectives ) {}
+
+	bool operator()( int a, int b ) const
+	{
+		return std::lexicographical_compare(	m_objectives + a * m_num_objectives, m_objectives + ( a + 1 ) * m_num_objectives,
+												m_objectives + b * m_num_objectives, m_objectives + ( b + 1 ) * m_num_objectives );
+	}
+
+	const double*	m_objectives;
+	int				m_num_objectives;
+};
+
+// orders points on a single objective
+struct ObjectiveLess
+{
+	ObjectiveLess( const double* objectives, int num_objectives, int objective ) : m_objectives( objectives ), m_num_objectives( num_objectives ), m_objective( objective ) {}
+
+	bool operator()( int a, int b ) const
+	{
+		return m_objectives[ a * m_num_objectives + m_objective ] < m_objectives[ b * m_num_objectives + m_objective ];
+	}
+
+	const double*	m_objectives;
+	int				m_num_objectives;
+	int				m_objective;
+};
+
+// orders points of a front by crowding distance, largest first
+struct MoreCrowded
+{
+	MoreCrowded( const std::vector< double >& distances ) : m_distances( distances ) {}
+
+	bool operator()( int a, int b ) const
+	{
+		return m_distances[ a ] > m_distances[ b ];
+	}
+
+	const std::vector< double >& m_distances;
+
+private:
+	MoreCrowded& operator=( const MoreCrowded& );
+};
+
+// true if a is no worse than b in every objective and better in at least one
+bool Dominates( const double* a, const double* b, int num_objectives )
+{
+	bool better = false;
+	for( int i = 0; i < num_objectives; ++i )
+	{
+		if ( a[ i ] > b[ i ] ) return false;
+		if ( a[ i ] < b[ i ] ) better = true;
+	}
+	return better;
+}
+
+// true if any point of the front dominates point. the latest added are the most
+// similar to it, so are checked first.
+bool FrontDominates( const std::vector< int >& front, const double* objectives, int num_objectives, int point )
+{
+	for( size_t i = front.size(); i > 0; --i )
+	{
+		if ( Dominates( objectives + front[ i - 1 ] * num_objectives, objectives + point * num_objectives, num_objectives ) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void GPRankNonDominated( const std::vector< double >& objectives, int num_objectives, std::vector< int >& ranked )
+{
+	assert( num_objectives > 0 && objectives.size() % num_objectives == 0 );
+
+	const int		num_points	= static_cast< int >( objectives.size() ) / num_objectives;
+	const double*	values		= num_points ? &objectives[ 0 ] : NULL;
+
+	std::vector< int > order( num_points );
+	for( int i = 0; i < num_points; ++i )
+	{
+		order[ i ] = i;
+	}
+	std::stable_sort( order.begin(), order.end(), LexicographicLess( values, num_objectives ) );
+
+	//
+	// put each point in the first front with nothing dominating it. a point dominated
+	// by something in one front is dominated by something in every front before it, so
+	// the fronts can be binary searched.
+	//
+	std::vector< std::vector< int > > fronts;
+	for( int i = 0; i < num_points; ++i )
+	{
+		int low		= 0;
+		int high	= static_cast< int >( fronts.size() );
+		while( low < high )
+		{
+			const int middle = ( low + high ) / 2;
+			if ( FrontDominates( fronts[ middle ], values, num_objectives, order[ i ] ) )
+			{
+				low = middle + 1;
+			}
+			else
+			{
+				high = middle;
+			}
+		}
+
+		if ( low == static_cast< int >( fronts.size() ) )
+		{
+			fronts.push_back( std::vector< int >() );
+		}
+		fronts[ low ].push_back( order[ i ] );
+	}
+
+	//
+	// within each front, the crowding distance is the sum over the objectives of the
+	// (normalised) gap between each point's neighbours. the ends are kept first.
+	//
+	ranked.clear();
+	ranked.reserve( num_points );
+
+	std::vector< double >	distances( num_points, 0.0 );
+	std::vector< int >		sorted;
+	for( size_t f = 0; f < fronts.size(); ++f )
+	{
+		const std::vector< int >& front = fronts[ f ];
+
+		for( int objective = 0; objective < num_objectives && front.size() > 2; ++objective )
+		{
+			sorted = front;
+			std::stable_sort( sorted.begin(), sorted.end(), ObjectiveLess( values, num_objectives, objective ) );
+
+			const double lowest		= values[ sorted.front() * num_objectives + objective ];
+			const double highest	= values[ sorted.back() * num_objectives + objective ];
+
+			distances[ sorted.front() ]	= std::numeric_limits< double >::infinity();
+			distances[ sorted.back() ]	= std::numeric_limits< double >::infinity();
+
+			if ( highest <= lowest ) continue;
+
+			for( size_t i = 1; i + 1 < sorted.size(); ++i )
+			{
+				const double gap = values[ sorted[ i + 1 ] * num_objectives + objective ] - values[ sorted[ i - 1 ] * num_objectives + objective ];
+				distances[ sorted[ i ] ] += gap / ( highest - lowest );
+			}
+		}
+
+		const size_t start = ranked.size();
+		ranked.insert( ranked.end(), front.begin(), front.end() );
+		std::stable_sort( ranked.begin() + start, ranked.end(), MoreCrowded( distances ) );
+	}
+}
@@ -37,7 +37,7 @@ GPStats::~GPStats()
 	m_stats.clear();
 }
 
-void GPStats::IncrementCounter( const char* name )
+void GPStats::IncrementCounter( const char* name, int amount )
 {
 	GPHash id = GPHashString( name, strlen( name ) );
 
@@ -45,7 +45,7 @@ void GPStats::IncrementCounter( const char* name )
 	{
 		GPStatsValue< int > *newStat = new GPStatsValue< int >();
 		strncpy( newStat->m_name, name, GP_DEBUGNAME_LEN );
-		newStat->m_value = 1;
+		newStat->m_value = amount;
 
 		m_stats[ id ] = newStat;
 	}
@@ -53,6 +53,6 @@ void GPStats::IncrementCounter( const char* name )
 	{
 		GPStatsValue< int > *currentStat = reinterpret_cast< GPStatsValue< int > * >( m_stats[ id ] );
 
-		++currentStat->m_value;
+		currentStat->m_value += amount;
 	}
 }
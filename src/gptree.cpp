@@ -25,9 +25,98 @@
 #include "gpdefines.h"
 #include "gptree.h"
 #include "gpfunctionlookup.h"
+#include <mutex>
 
 const int GPConstSubtreeIter::INVALID_INDEX = -1;
 
+// ---------------------------------------------------------------------------
+// GPTreeNode pool
+//		Each thread keeps a free list of node sized blocks, allocated a chunk
+//		at a time and never given back to the system. A node freed on another
+//		thread joins that thread's list. When a thread exits its list is left
+//		as spare, for the next thread which runs out to take over.
+//
+static const int kNodesPerChunk = 256;
+
+struct GPFreeNode
+{
+	GPFreeNode* m_next;
+};
+
+struct GPNodePool
+{
+	GPNodePool() : m_free( NULL ) {}
+	~GPNodePool();
+
+	GPFreeNode* m_free;
+};
+
+static std::mutex	s_spare_lock;
+static GPFreeNode*	s_spare_nodes = NULL;
+
+static thread_local GPNodePool t_node_pool;
+
+GPNodePool::~GPNodePool()
+{
+	if ( m_free == NULL ) return;
+
+	GPFreeNode* last = m_free;
+	while( last->m_next ) last = last->m_next;
+
+	std::lock_guard< std::mutex > lock( s_spare_lock );
+	last->m_next	= s_spare_nodes;
+	s_spare_nodes	= m_free;
+	m_free			= NULL;
+}
+
+void* GPTreeNode::operator new( size_t size )
+{
+	if ( size != sizeof( GPTreeNode ) )
+	{
+		return ::operator new( size );
+	}
+
+	GPNodePool& pool = t_node_pool;
+	if ( pool.m_free == NULL )
+	{
+		{
+			std::lock_guard< std::mutex > lock( s_spare_lock );
+			pool.m_free		= s_spare_nodes;
+			s_spare_nodes	= NULL;
+		}
+
+		if ( pool.m_free == NULL )
+		{
+			char* chunk = static_cast< char* >( ::operator new( kNodesPerChunk * sizeof( GPTreeNode ) ) );
+			for( int i = kNodesPerChunk - 1; i >= 0; --i )
+			{
+				GPFreeNode* block = reinterpret_cast< GPFreeNode* >( chunk + i * sizeof( GPTreeNode ) );
+				block->m_next	= pool.m_free;
+				pool.m_free		= block;
+			}
+		}
+	}
+
+	GPFreeNode* node = pool.m_free;
+	pool.m_free = node->m_next;
+	return node;
+}
+
+void GPTreeNode::operator delete( void* node, size_t size )
+{
+	if ( node == NULL ) return;
+
+	if ( size != sizeof( GPTreeNode ) )
+	{
+		::operator delete( node );
+		return;
+	}
+
+	GPFreeNode* block = static_cast< GPFreeNode* >( node );
+	block->m_next = t_node_pool.m_free;
+	t_node_pool.m_free = block;
+}
+
 GPConstSubtreeIter::GPConstSubtreeIter( const GPTree* tree )
 {
 	m_flattened = tree->Flatten();
@@ -50,7 +139,7 @@ int GPConstSubtreeIter::Random( bool prefer_nonroot ) const
 	const int offset = ( prefer_nonroot ? 1 : 0 );
 	return	m_count == 0	? INVALID_INDEX :
 			m_count == 1	? 0 
-							: ( offset + rand() % ( m_count - offset ) );
+							: ( offset + GPRand() % ( m_count - offset ) );
 }
 
 int GPConstSubtreeIter::Random( const GPFunctionLookup& functions, GPTypeID return_type, bool prefer_nonroot ) const
@@ -58,7 +147,7 @@ int GPConstSubtreeIter::Random( const GPFunctionLookup& functions, GPTypeID retu
 	if ( m_count == 0 ) return INVALID_INDEX;
 
 	const int offset = ( prefer_nonroot ? 1 : 0 );
-	int selected_start_index = m_count == 1 ? 0 : ( offset + rand() % ( m_count - offset ) );
+	int selected_start_index = m_count == 1 ? 0 : ( offset + GPRand() % ( m_count - offset ) );
 
 	int current_index = selected_start_index;
 	do
@@ -150,7 +239,7 @@ GPReturnTypeIter::GPReturnTypeIter( GPTree::FlattenedTreePtr flattened, int num_
 	// look for an index with our returntype to stop on.
 	// UGLY: temporarily use m_current_index to know if we're looping.
 	//
-	m_start_index	= ( flags & RANDOM_START ) ? ( rand() % num_nodes ) : ( num_nodes - 1 );
+	m_start_index	= ( flags & RANDOM_START ) ? ( GPRand() % num_nodes ) : ( num_nodes - 1 );
 	m_current_index	= m_start_index;
 	do
 	{
@@ -189,7 +278,7 @@ GPTree::GPTree( const GPTree* other )
 
 GPTree::~GPTree()
 {
-	DeleteSubtree( m_root );
+	if ( m_root ) DeleteSubtree( m_root );
 }
 
 const GPTreeNode*	GPTree::Root() const
@@ -215,6 +304,86 @@ GPTree*				GPTree::Duplicate() const
 	return new_tree;
 }
 
+GPHash				GPTree::Hash() const
+{
+	// FNV offset basis
+	GPHash hash = 2166136261U;
+	if ( m_root )
+	{
+		HashSubtree( m_root, hash );
+	}
+	return hash;
+}
+
+void				GPTree::HashSubtree( const GPTreeNode* node, GPHash& hash )
+{
+	// FNV, a function ID at a time. every function has a fixed number of parameters,
+	// so the preorder sequence identifies the structure.
+	hash = ( hash ^ static_cast< GPHash >( node->functionID ) ) * 16777619;
+
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+	{
+		if ( node->parameters[ i ] )
+		{
+			HashSubtree( node->parameters[ i ], hash );
+		}
+	}
+}
+
+void				GPTree::CopyFrom( const GPTree* other )
+{
+	assert( other != this );
+
+	m_max_nodes	= other->m_max_nodes;
+	m_count		= other->m_count;
+
+	if ( other->m_root )
+	{
+		m_root = CopySubtree( m_root, other->m_root );
+		m_root->parent = NULL;
+	}
+	else if ( m_root )
+	{
+		DeleteSubtree( m_root );
+		m_root = NULL;
+	}
+}
+
+void				GPTree::Clear( int max_nodes )
+{
+	if ( m_root ) DeleteSubtree( m_root );
+
+	m_max_nodes	= max_nodes;
+	m_count		= 0;
+	m_root		= NULL;
+}
+
+GPTreeNode*	GPTree::CopySubtree( GPTreeNode* existing, const GPTreeNode* source )
+{
+	if ( existing == NULL )
+	{
+		return Duplicate( source );
+	}
+
+	existing->functionID = source->functionID;
+
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+	{
+		if ( source->parameters[ i ] )
+		{
+			existing->parameters[ i ] = CopySubtree( existing->parameters[ i ], source->parameters[ i ] );
+			existing->parameters[ i ]->parent = existing;
+		}
+		else if ( existing->parameters[ i ] )
+		{
+			DeleteSubtree( existing->parameters[ i ] );
+			existing->parameters[ i ] = NULL;
+		}
+	}
+
+	return existing;
+}
+
 GPTreeNode*	GPTree::Duplicate( const GPTreeNode * sourceTree )
 {
 	GPTreeNode * newNode = new GPTreeNode( sourceTree->functionID );
@@ -346,6 +515,64 @@ GPTreeNode*		GPTree::Replace( const GPTreeNode* source_node, GPTreeNode* new_sub
 	}
 }
 
+void			GPTree::SetFunction( const GPTreeNode* node, GPFuncID function )
+{
+	assert( Contains( node ) );
+
+	const_cast< GPTreeNode* >( node )->functionID = function;
+}
+
+void			GPTree::Hoist( const GPTreeNode* node )
+{
+	assert( Contains( node ) );
+
+	if ( node == m_root ) return;
+
+	GPTreeNode* subtree = const_cast< GPTreeNode* >( node );
+
+	// cut the subtree loose, so deleting the rest leaves it alone
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+	{
+		if ( subtree->parent->parameters[ i ] == subtree )
+		{
+			subtree->parent->parameters[ i ] = NULL;
+			break;
+		}
+	}
+	DeleteSubtree( m_root );
+
+	subtree->parent	= NULL;
+	m_root			= subtree;
+	m_count			= CountSubtree( m_root );
+}
+
+void			GPTree::Collapse( const GPTreeNode* node, GPFuncID terminal )
+{
+	assert( Contains( node ) );
+
+	GPTreeNode* leaf = const_cast< GPTreeNode* >( node );
+
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+	{
+		if ( leaf->parameters[ i ] )
+		{
+			m_count -= CountSubtree( leaf->parameters[ i ] );
+			DeleteSubtree( leaf->parameters[ i ] );
+			leaf->parameters[ i ] = NULL;
+		}
+	}
+
+	leaf->functionID = terminal;
+}
+
+bool			GPTree::Contains( const GPTreeNode* node ) const
+{
+	const GPTreeNode * parent;
+	for( parent = node; parent != NULL && parent != m_root; parent = parent->parent );
+
+	return parent != NULL;
+}
+
 GPTreeNode*		GPTree::Stitch( const GPFunctionLookup& functions, FlattenedTreePtr flattened, int num_flattened_nodes, int max_nodes )
 {
 	int parameters_index = 1;
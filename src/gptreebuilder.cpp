@@ -0,0 +1,242 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gpdefines.h"
+#include "gptreebuilder.h"
+#include <limits>
+#include <set>
+
+const int GPTreeBuilder::kUnbuildable = std::numeric_limits< int >::max();
+
+GPTreeBuilder::GPTreeBuilder( const GPFunctionLookup& functions )
+	: m_functions( functions )
+{
+	for( int i = 0; i < m_functions.GetNumFunctions(); ++i )
+	{
+		const GPFunctionDesc& desc	= m_functions.GetFunctionByID( i );
+		TypeTable& table			= m_types[ desc.m_return_type ];
+
+		if ( desc.m_nparams == 0 )
+		{
+			table.m_terminals.push_back( i );
+		}
+		else
+		{
+			table.m_nonterminals.push_back( i );
+		}
+		table.m_all.push_back( i );
+	}
+
+	CalculateMinimums();
+}
+
+const GPTreeBuilder::TypeTable* GPTreeBuilder::FindTable( GPTypeID type ) const
+{
+	TypeTableMap::const_iterator iter = m_types.find( type );
+	return iter != m_types.end() ? &iter->second : NULL;
+}
+
+void GPTreeBuilder::CalculateMinimums()
+{
+	const int num_functions = m_functions.GetNumFunctions();
+	m_function_min_size.assign( num_functions, kUnbuildable );
+	m_function_min_depth.assign( num_functions, kUnbuildable );
+
+	// each pass can only shrink the minimums, so this ends once a pass changes nothing
+	bool changed = true;
+	while( changed )
+	{
+		changed = false;
+
+		for( int i = 0; i < num_functions; ++i )
+		{
+			const GPFunctionDesc& desc = m_functions.GetFunctionByID( i );
+
+			int size	= 1;
+			int depth	= 0;
+			for( int j = 0; j < desc.m_nparams && size != kUnbuildable; ++j )
+			{
+				const TypeTable* param_table = FindTable( desc.m_param_types[ j ] );
+				if ( param_table == NULL || param_table->m_min_size == kUnbuildable )
+				{
+					size = depth = kUnbuildable;
+				}
+				else
+				{
+					size	+= param_table->m_min_size;
+					depth	= std::max( depth, param_table->m_min_depth + 1 );
+				}
+			}
+
+			if ( size == kUnbuildable ) continue;
+
+			TypeTable& table = m_types[ desc.m_return_type ];
+			if ( size < m_function_min_size[ i ] )
+			{
+				m_function_min_size[ i ]	= size;
+				table.m_min_size			= std::min( table.m_min_size, size );
+				changed = true;
+			}
+			if ( depth < m_function_min_depth[ i ] )
+			{
+				m_function_min_depth[ i ]	= depth;
+				table.m_min_depth			= std::min( table.m_min_depth, depth );
+				changed = true;
+			}
+		}
+	}
+}
+
+bool GPTreeBuilder::CanBuild( GPTypeID return_type, int max_nodes )
+{
+	std::ostringstream error;
+
+	const TypeTable* table = FindTable( return_type );
+	if ( table == NULL )
+	{
+		error << "no function returns the type asked for";
+	}
+	else if ( table->m_min_size == kUnbuildable )
+	{
+		// name the functions which can be reached from the return type, but never finished
+		std::set< GPTypeID >	visited;
+		std::vector< GPTypeID >	pending( 1, return_type );
+		const char*				separator = "";
+
+		error << "no finite tree can be built, as some parameter types can't be ended by a terminal. the functions which can never be finished are: ";
+		while( !pending.empty() )
+		{
+			const GPTypeID type = pending.back();
+			pending.pop_back();
+
+			const TypeTable* type_table = FindTable( type );
+			if ( !visited.insert( type ).second || type_table == NULL ) continue;
+
+			for( size_t i = 0; i < type_table->m_all.size(); ++i )
+			{
+				const GPFunctionDesc& desc = m_functions.GetFunctionByID( type_table->m_all[ i ] );
+				if ( m_function_min_size[ type_table->m_all[ i ] ] != kUnbuildable ) continue;
+
+				error << separator << desc.m_debug_name;
+				separator = ", ";
+
+				for( int j = 0; j < desc.m_nparams; ++j )
+				{
+					pending.push_back( desc.m_param_types[ j ] );
+				}
+			}
+		}
+	}
+	else if ( table->m_min_size > max_nodes )
+	{
+		error << "the smallest tree possible has " << table->m_min_size << " nodes, more than the max of " << max_nodes;
+	}
+
+	m_error = error.str();
+	return m_error.empty();
+}
+
+GPTreeNode* GPTreeBuilder::Build( GPTypeID return_type, GPBuildMethod method, int max_depth, int max_nodes, int& nodes_used ) const
+{
+	// the root always takes parameters (where the depth allows), as a lone terminal
+	// is a waste of an individual
+	return BuildNode( return_type, method, max_depth, max_nodes, nodes_used, true );
+}
+
+GPTreeNode* GPTreeBuilder::BuildNode( GPTypeID type, GPBuildMethod method, int depth_left, int max_nodes, int& nodes_used, bool root ) const
+{
+	const TypeTable* table = FindTable( type );
+
+	// if this assert fires, CanBuild would have returned false
+	assert( table && table->m_min_size <= max_nodes );
+
+	GPFuncID function = GPFunctionLookup::NULLFUNC;
+	if ( depth_left > 0 )
+	{
+		function = PickFunction( method == GP_BUILD_FULL || root ? table->m_nonterminals : table->m_all, depth_left, max_nodes );
+	}
+
+	// at the max depth, or nothing deeper fits
+	if ( function == GPFunctionLookup::NULLFUNC )
+	{
+		function = PickFunction( table->m_terminals, 0, max_nodes );
+	}
+
+	// no terminal for this type, so the depth has to give. the nodes never do.
+	if ( function == GPFunctionLookup::NULLFUNC )
+	{
+		function = PickFunction( table->m_all, std::numeric_limits< int >::max(), max_nodes );
+	}
+
+	assert( function != GPFunctionLookup::NULLFUNC );
+
+	const GPFunctionDesc& desc = m_functions.GetFunctionByID( function );
+	GPTreeNode* node = new GPTreeNode( function );
+
+	// every parameter is sure of its smallest subtree, and they take turns at the spare nodes
+	int spare	= max_nodes - m_function_min_size[ function ];
+	nodes_used	= 1;
+
+	for( int j = 0; j < desc.m_nparams; ++j )
+	{
+		const int param_min_size = FindTable( desc.m_param_types[ j ] )->m_min_size;
+
+		int param_nodes_used;
+		node->parameters[ j ] = BuildNode( desc.m_param_types[ j ], method, depth_left - 1, param_min_size + spare, param_nodes_used, false );
+		node->parameters[ j ]->parent = node;
+
+		spare		-= param_nodes_used - param_min_size;
+		nodes_used	+= param_nodes_used;
+	}
+
+	return node;
+}
+
+GPFuncID GPTreeBuilder::PickFunction( const std::vector< GPFuncID >& list, int depth_left, int max_nodes ) const
+{
+	int num_fits = 0;
+	for( size_t i = 0; i < list.size(); ++i )
+	{
+		if ( m_function_min_size[ list[ i ] ] <= max_nodes && m_function_min_depth[ list[ i ] ] <= depth_left )
+		{
+			++num_fits;
+		}
+	}
+
+	if ( num_fits == 0 )
+	{
+		return GPFunctionLookup::NULLFUNC;
+	}
+
+	int pick = GPRand() % num_fits;
+	for( size_t i = 0; i < list.size(); ++i )
+	{
+		if ( m_function_min_size[ list[ i ] ] <= max_nodes && m_function_min_depth[ list[ i ] ] <= depth_left && pick-- == 0 )
+		{
+			return list[ i ];
+		}
+	}
+
+	return GPFunctionLookup::NULLFUNC;
+}
@@ -0,0 +1,411 @@
+/*
+ * This source file is part of libGP C++ library.
+ * 
+ * Copyright (c) 2011 Craig Furness
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gpdefines.h"
+#include "gpenvironment.h"
+#include "gpworkerpool.h"
+
+#if !defined( _WIN32 )
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#define GP_WORKERPOOL_SUPPORTED
+#endif
+
+// writes to a worker which has died shouldn't raise SIGPIPE and take the host down with it
+#if defined( MSG_NOSIGNAL )
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+void* GPAllocateSharedMemory( size_t bytes )
+{
+#ifdef GP_WORKERPOOL_SUPPORTED
+	void* memory = mmap( NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	return memory == MAP_FAILED ? NULL : memory;
+#else
+	return NULL;
+#endif
+}
+
+void GPFreeSharedMemory( void* memory, size_t bytes )
+{
+#ifdef GP_WORKERPOOL_SUPPORTED
+	if ( memory ) munmap( memory, bytes );
+#endif
+}
+
+#ifdef GP_WORKERPOOL_SUPPORTED
+
+static bool WriteAll( int socket, const void* data, size_t bytes )
+{
+	const char* next = static_cast< const char* >( data );
+	while( bytes > 0 )
+	{
+		ssize_t written = send( socket, next, bytes, kSendFlags );
+		if ( written < 0 && errno == EINTR ) continue;
+		if ( written <= 0 ) return false;
+
+		next	+= written;
+		bytes	-= written;
+	}
+	return true;
+}
+
+// false if the other end has closed (or died) before all the bytes arrived
+static bool ReadAll( int socket, void* data, size_t bytes )
+{
+	char* next = static_cast< char* >( data );
+	while( bytes > 0 )
+	{
+		ssize_t read = recv( socket, next, bytes, 0 );
+		if ( read < 0 && errno == EINTR ) continue;
+		if ( read <= 0 ) return false;
+
+		next	+= read;
+		bytes	-= read;
+	}
+	return true;
+}
+
+#endif
+
+static void AppendPreorder( const GPTreeNode* node, std::vector< GPFuncID >& preorder )
+{
+	preorder.push_back( node->functionID );
+	for( int i = 0; i < GP_MAX_PARAMETERS; ++i )
+	{
+		if ( node->parameters[ i ] ) AppendPreorder( node->parameters[ i ], preorder );
+	}
+}
+
+// rebuilds the subtree starting at next, leaving next after its last node
+static GPTreeNode* BuildFromPreorder( const GPFunctionLookup& functions, const GPFuncID*& next )
+{
+	GPTreeNode* node = new GPTreeNode( *next++ );
+
+	const GPFunctionDesc& desc = functions.GetFunctionByID( node->functionID );
+	for( int i = 0; i < desc.m_nparams; ++i )
+	{
+		node->parameters[ i ] = BuildFromPreorder( functions, next );
+		node->parameters[ i ]->parent = node;
+	}
+
+	return node;
+}
+
+GPWorkerPool::GPWorkerPool()
+{
+	m_environment	= NULL;
+	m_num_restarts	= 0;
+}
+
+GPWorkerPool::~GPWorkerPool()
+{
+	Stop();
+}
+
+bool GPWorkerPool::Start( GPEnvironment& environment, int num_workers )
+{
+	Stop();
+
+#ifdef GP_WORKERPOOL_SUPPORTED
+	m_environment = &environment;
+	m_workers.resize( num_workers );
+
+	for( int i = 0; i < num_workers; ++i )
+	{
+		m_workers[ i ].m_pid	= -1;
+		m_workers[ i ].m_socket	= -1;
+		m_workers[ i ].m_busy	= false;
+	}
+
+	for( int i = 0; i < num_workers; ++i )
+	{
+		if ( !Fork( m_workers[ i ] ) )
+		{
+			Stop();
+			return false;
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void GPWorkerPool::Stop()
+{
+	for( size_t i = 0; i < m_workers.size(); ++i )
+	{
+		Kill( m_workers[ i ] );
+	}
+
+	m_workers.clear();
+	m_crashed.clear();
+	m_environment = NULL;
+}
+
+bool GPWorkerPool::HasIdleWorker() const
+{
+	for( size_t i = 0; i < m_workers.size(); ++i )
+	{
+		if ( !m_workers[ i ].m_busy ) return true;
+	}
+	return false;
+}
+
+int GPWorkerPool::GetNumOutstanding() const
+{
+	int outstanding = static_cast< int >( m_crashed.size() );
+	for( size_t i = 0; i < m_workers.size(); ++i )
+	{
+		if ( m_workers[ i ].m_busy ) ++outstanding;
+	}
+	return outstanding;
+}
+
+void GPWorkerPool::Submit( int index, const GPTree* tree, GPFitness cutoff )
+{
+	Worker* worker = NULL;
+	for( size_t i = 0; i < m_workers.size() && worker == NULL; ++i )
+	{
+		if ( !m_workers[ i ].m_busy ) worker = &m_workers[ i ];
+	}
+
+	// if this assert fires there was no idle worker, Collect() until HasIdleWorker()
+	assert( worker );
+
+	m_preorder.clear();
+	AppendPreorder( tree->Root(), m_preorder );
+
+	worker->m_request.m_index		= index;
+	worker->m_request.m_cutoff		= cutoff;
+	worker->m_request.m_num_nodes	= static_cast< int >( m_preorder.size() );
+	worker->m_request.m_max_nodes	= tree->MaxNodes();
+	worker->m_busy					= true;
+
+	// the worker may have died while idle. if so, give the request to its replacement
+	if ( !Send( *worker ) )
+	{
+		Restart( *worker );
+		worker->m_busy = true;
+
+		if ( !Send( *worker ) )
+		{
+			m_crashed.push_back( CrashedResult( *worker ) );
+			worker->m_busy = false;
+		}
+	}
+}
+
+GPEvaluator::Result GPWorkerPool::Collect()
+{
+	assert( GetNumOutstanding() > 0 );
+
+	if ( !m_crashed.empty() )
+	{
+		Result crashed = m_crashed.back();
+		m_crashed.pop_back();
+		return crashed;
+	}
+
+#ifdef GP_WORKERPOOL_SUPPORTED
+	std::vector< pollfd >	polled;
+	std::vector< Worker* >	polled_workers;
+	for( size_t i = 0; i < m_workers.size(); ++i )
+	{
+		if ( m_workers[ i ].m_busy )
+		{
+			pollfd entry = { m_workers[ i ].m_socket, POLLIN, 0 };
+			polled.push_back( entry );
+			polled_workers.push_back( &m_workers[ i ] );
+		}
+	}
+
+	while( poll( &polled[ 0 ], polled.size(), -1 ) < 0 && errno == EINTR );
+
+	for( size_t i = 0; i < polled.size(); ++i )
+	{
+		if ( polled[ i ].revents == 0 ) continue;
+
+		Worker& worker = *polled_workers[ i ];
+
+		Response response;
+		if ( !ReadAll( worker.m_socket, &response, sizeof( response ) ) )
+		{
+			Result crashed = CrashedResult( worker );
+			Restart( worker );
+			return crashed;
+		}
+
+		worker.m_busy = false;
+
+		Result result;
+		result.m_index		= worker.m_request.m_index;
+		result.m_cutoff		= worker.m_request.m_cutoff;
+		result.m_fitness	= response.m_fitness;
+		result.m_overrun	= response.m_overrun;
+		result.m_seconds	= response.m_seconds;
+		result.m_crashed	= false;
+		return result;
+	}
+#endif
+
+	// only reached if poll failed outright. give up on the first outstanding individual
+	for( size_t i = 0; i < m_workers.size(); ++i )
+	{
+		if ( m_workers[ i ].m_busy )
+		{
+			Result crashed = CrashedResult( m_workers[ i ] );
+			Restart( m_workers[ i ] );
+			return crashed;
+		}
+	}
+
+	assert( false );
+	return Result();
+}
+
+bool GPWorkerPool::Send( Worker& worker )
+{
+#ifdef GP_WORKERPOOL_SUPPORTED
+	if ( worker.m_socket < 0 ) return false;
+
+	return	WriteAll( worker.m_socket, &worker.m_request, sizeof( Request ) ) &&
+			WriteAll( worker.m_socket, &m_preorder[ 0 ], m_preorder.size() * sizeof( GPFuncID ) );
+#else
+	return false;
+#endif
+}
+
+GPEvaluator::Result GPWorkerPool::CrashedResult( const Worker& worker ) const
+{
+	Result result;
+	result.m_index		= worker.m_request.m_index;
+	result.m_cutoff		= worker.m_request.m_cutoff;
+	result.m_fitness	= -std::numeric_limits<double>::max();
+	result.m_overrun	= false;
+	result.m_seconds	= 0;
+	result.m_crashed	= true;
+	return result;
+}
+
+bool GPWorkerPool::Fork( Worker& worker )
+{
+#ifdef GP_WORKERPOOL_SUPPORTED
+	int sockets[ 2 ];
+	if ( socketpair( AF_UNIX, SOCK_STREAM, 0, sockets ) != 0 ) return false;
+
+	// anything buffered would otherwise be written out by both processes
+	std::cout.flush();
+	fflush( NULL );
+
+	const pid_t pid = fork();
+	if ( pid < 0 )
+	{
+		close( sockets[ 0 ] );
+		close( sockets[ 1 ] );
+		return false;
+	}
+
+	if ( pid == 0 )
+	{
+		// the other workers' sockets have to be closed here, else they would only see
+		// the end of their requests once this worker exited as well
+		for( size_t i = 0; i < m_workers.size(); ++i )
+		{
+			if ( m_workers[ i ].m_socket >= 0 ) close( m_workers[ i ].m_socket );
+		}
+		close( sockets[ 0 ] );
+
+		WorkerMain( *m_environment, sockets[ 1 ] );
+
+		// leave without running destructors or atexit handlers meant for the host
+		_exit( 0 );
+	}
+
+	close( sockets[ 1 ] );
+	worker.m_pid	= pid;
+	worker.m_socket	= sockets[ 0 ];
+	return true;
+#else
+	return false;
+#endif
+}
+
+void GPWorkerPool::Kill( Worker& worker )
+{
+#ifdef GP_WORKERPOOL_SUPPORTED
+	// an idle worker exits by itself once its socket closes, a busy one may never finish
+	if ( worker.m_socket >= 0 ) close( worker.m_socket );
+	if ( worker.m_pid > 0 )
+	{
+		if ( worker.m_busy ) kill( worker.m_pid, SIGKILL );
+		while( waitpid( worker.m_pid, NULL, 0 ) < 0 && errno == EINTR );
+	}
+#endif
+
+	worker.m_pid	= -1;
+	worker.m_socket	= -1;
+	worker.m_busy	= false;
+}
+
+void GPWorkerPool::Restart( Worker& worker )
+{
+	Kill( worker );
+	Fork( worker );
+	++m_num_restarts;
+}
+
+void GPWorkerPool::WorkerMain( GPEnvironment& environment, int socket )
+{
+#ifdef GP_WORKERPOOL_SUPPORTED
+	std::vector< GPFuncID > preorder;
+	Request request;
+
+	while( ReadAll( socket, &request, sizeof( request ) ) )
+	{
+		preorder.resize( request.m_num_nodes );
+		if ( !ReadAll( socket, &preorder[ 0 ], preorder.size() * sizeof( GPFuncID ) ) ) break;
+
+		const GPFuncID* next = &preorder[ 0 ];
+		GPTree* tree = new GPTree( request.m_max_nodes );
+		tree->Replace( NULL, BuildFromPreorder( environment.GetFunctions(), next ) );
+
+		Response response;
+		response.m_fitness = environment.EvaluateForWorker( request.m_index, tree, request.m_cutoff, response.m_overrun, response.m_seconds );
+
+		if ( !WriteAll( socket, &response, sizeof( response ) ) ) break;
+	}
+
+	close( socket );
+#endif
+}